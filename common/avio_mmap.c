@@ -0,0 +1,194 @@
+// mmap()、posix_madvise()、fstat()，各工程使用-std=c99编译
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "avio_mmap.h"
+
+// AVIOContext的缓冲区大小。数据已在内存中，缓冲区大一些可减少读回调的次数
+#define MMAP_IO_BUF_SIZE    (256 * 1024)
+// seek后提示内核预读的长度
+#define MMAP_WILLNEED_SIZE  (4 * 1024 * 1024)
+
+#ifndef _WIN32
+typedef struct {
+    uint8_t *data;                  // 映射区
+    int64_t size;                   // 文件长度
+    int64_t pos;                    // 读位置
+}   mmap_file_t;
+
+// 提示内核即将读取[pos, pos + MMAP_WILLNEED_SIZE)区间，建议失败不影响读取
+static void advise_willneed(mmap_file_t *mf, int64_t pos) {
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t start = pos - pos % page;
+    int64_t len = FFMIN(mf->size - start, MMAP_WILLNEED_SIZE);
+
+    if (len > 0) {
+        posix_madvise(mf->data + start, len, POSIX_MADV_WILLNEED);
+    }
+}
+
+static int read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    mmap_file_t *mf = opaque;
+    int64_t len = FFMIN(buf_size, mf->size - mf->pos);
+
+    if (len <= 0) {
+        return AVERROR_EOF;
+    }
+    memcpy(buf, mf->data + mf->pos, len);
+    mf->pos += len;
+
+    return (int)len;
+}
+
+static int64_t seek(void *opaque, int64_t offset, int whence) {
+    mmap_file_t *mf = opaque;
+    int64_t pos;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return mf->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = mf->pos + offset;
+        break;
+    case SEEK_END:
+        pos = mf->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > mf->size) {
+        return AVERROR(EINVAL);
+    }
+    mf->pos = pos;
+    advise_willneed(mf, pos);
+
+    return pos;
+}
+
+// 1. 只映射普通文件，空文件也不映射
+// 2. 映射整个文件，提示内核按顺序访问，并预读文件开头
+// 3. 创建使用读回调的AVIOContext
+int avio_mmap_open(AVIOContext **pb, const char *filename) {
+    const char *path = filename;
+    mmap_file_t *mf = NULL;
+    uint8_t *io_buf = NULL;
+    struct stat st;
+    void *data;
+    int fd, ret;
+
+    // 1
+    if (av_strstart(filename, "file:", &path) == 0 && strstr(filename, "://")) {
+        return AVERROR(ENOSYS);
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return AVERROR(errno);
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return AVERROR(ENOSYS);
+    }
+
+    // 2
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ret = AVERROR(errno);
+    close(fd);                      // 映射区不依赖文件描述符
+    if (data == MAP_FAILED) {
+        return ret;
+    }
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    // 3
+    mf = av_mallocz(sizeof(mmap_file_t));
+    io_buf = av_malloc(MMAP_IO_BUF_SIZE);
+    if (!mf || !io_buf) {
+        goto fail;
+    }
+    mf->data = data;
+    mf->size = st.st_size;
+    advise_willneed(mf, 0);
+    *pb = avio_alloc_context(io_buf, MMAP_IO_BUF_SIZE, 0, mf, read_packet, NULL, seek);
+    if (!*pb) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    av_free(io_buf);
+    av_free(mf);
+    munmap(data, st.st_size);
+    return AVERROR(ENOMEM);
+}
+
+void avio_mmap_close(AVIOContext **pb) {
+    mmap_file_t *mf;
+
+    if (!*pb) {
+        return;
+    }
+    mf = (*pb)->opaque;
+    munmap(mf->data, mf->size);
+    av_free(mf);
+    // AVIOContext内部的缓冲区可能已被重新分配，不一定是创建时传入的缓冲区
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
+#else
+// Windows工程(player_avsync)没有mmap()，总是回退到默认的file协议
+int avio_mmap_open(AVIOContext **pb, const char *filename) {
+    return AVERROR(ENOSYS);
+}
+
+void avio_mmap_close(AVIOContext **pb) {
+}
+#endif
+
+int avio_mmap_open_input(AVFormatContext **fmt_ctx, const char *filename, AVInputFormat *fmt,
+                         AVDictionary **options, int use_mmap) {
+    AVIOContext *pb = NULL;
+    int ret;
+
+    if (!use_mmap || avio_mmap_open(&pb, filename) < 0) {
+        return avformat_open_input(fmt_ctx, filename, fmt, options);
+    }
+
+    // fmt_ctx可能已由调用者分配(如设置了中断回调)
+    if (!*fmt_ctx && !(*fmt_ctx = avformat_alloc_context())) {
+        avio_mmap_close(&pb);
+        return AVERROR(ENOMEM);
+    }
+    (*fmt_ctx)->pb = pb;
+    // 失败时avformat_open_input()释放fmt_ctx，但不释放自定义的pb
+    if ((ret = avformat_open_input(fmt_ctx, filename, fmt, options)) < 0) {
+        avio_mmap_close(&pb);
+    }
+
+    return ret;
+}
+
+void avio_mmap_close_input(AVFormatContext **fmt_ctx) {
+    AVIOContext *pb = NULL;
+
+    if (*fmt_ctx && ((*fmt_ctx)->flags & AVFMT_FLAG_CUSTOM_IO)) {
+        pb = (*fmt_ctx)->pb;
+    }
+    avformat_close_input(fmt_ctx);
+    avio_mmap_close(&pb);
+}
@@ -0,0 +1,20 @@
+#ifndef __AVIO_MMAP_H__
+#define __AVIO_MMAP_H__
+
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+
+// 基于mmap的只读AVIOContext，用法参考ffmpeg_examples/avio_reading.c中的自定义AVIOContext
+// 默认的file协议每读32KiB做一次read()系统调用。这里将整个本地文件映射到内存，读回调只从映射区复制数据，
+// 没有系统调用，缺页时由内核按顺序访问的提示预读。映射区在整个读取期间有效，seek只改变读位置
+// 管道、设备、网络URL等非普通文件，以及映射失败(如32位系统上的大文件)时返回错误，调用者应回退到默认的file协议
+int avio_mmap_open(AVIOContext **pb, const char *filename);
+void avio_mmap_close(AVIOContext **pb);
+
+// avformat_open_input()的替代：use_mmap为真且filename是普通文件时通过avio_mmap_open()读取，否则使用默认协议
+// 用此函数打开的输入必须用avio_mmap_close_input()关闭
+int avio_mmap_open_input(AVFormatContext **fmt_ctx, const char *filename, AVInputFormat *fmt,
+                         AVDictionary **options, int use_mmap);
+void avio_mmap_close_input(AVFormatContext **fmt_ctx);
+
+#endif
@@ -1,9 +1,19 @@
 #include <stdlib.h>
+#include <string.h>
 #include <libavformat/avformat.h>
+#include "avio_mmap.h"
 
 int main (int argc, char **argv) {
+    int use_mmap = 0;
+
+    // -mmap: 通过内存映射读取本地输入文件
+    if (argc > 1 && strcmp(argv[1], "-mmap") == 0) {
+        use_mmap = 1;
+        argv++;
+        argc--;
+    }
     if (argc != 4) {
-        fprintf(stderr, "usage: %s input output.h264 output.aac\n", argv[0]);
+        fprintf(stderr, "usage: %s [-mmap] input output.h264 output.aac\n", argv[0]);
         exit(1);
     }
 
@@ -21,7 +31,7 @@ int main (int argc, char **argv) {
     }
 
     AVFormatContext *ifmt_ctx = NULL;
-    if ((ret = avformat_open_input(&ifmt_ctx, in_filename, 0, 0)) < 0) {
+    if ((ret = avio_mmap_open_input(&ifmt_ctx, in_filename, 0, 0, use_mmap)) < 0) {
         fprintf(stderr, "Could not open input file '%s'", in_filename);
         goto end;
     } 
@@ -57,7 +67,7 @@ int main (int argc, char **argv) {
     printf("Demuxing succeeded.\n");
 
 end:
-    avformat_close_input(&ifmt_ctx);
+    avio_mmap_close_input(&ifmt_ctx);
     fclose(video_dst_file);
     fclose(audio_dst_file);
 
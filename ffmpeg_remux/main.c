@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
 #include <libavutil/timestamp.h>
 #include <libavformat/avformat.h>
+#include "avio_mmap.h"
 
 void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt, const char *tag) {
     AVRational *time_base = &fmt_ctx->streams[pkt->stream_index]->time_base;
@@ -22,9 +24,16 @@ int main(int argc, char **argv) {
     int stream_index = 0;
     int *stream_mapping = NULL;
     int stream_mapping_size = 0;
+    int use_mmap = 0;
 
+    // -mmap: 通过内存映射读取本地输入文件
+    if (argc > 1 && strcmp(argv[1], "-mmap") == 0) {
+        use_mmap = 1;
+        argv++;
+        argc--;
+    }
     if (argc < 3) {
-        printf("usage: %s input output\n"
+        printf("usage: %s [-mmap] input output\n"
                "API example program to remux a media file with libavformat and libavcodec.\n"
                "The output format is guessed according to the file extension.\n"
                "\n", argv[0]);
@@ -36,7 +45,7 @@ int main(int argc, char **argv) {
 
     // 1. 打开输入
     // 1.1 读取文件头，获取封装格式相关信息
-    if ((ret = avformat_open_input(&ifmt_ctx, in_filename, 0, 0)) < 0) {
+    if ((ret = avio_mmap_open_input(&ifmt_ctx, in_filename, 0, 0, use_mmap)) < 0) {
         printf("Could not open input file '%s'", in_filename);
         goto end;
     }
@@ -159,7 +168,7 @@ int main(int argc, char **argv) {
     av_write_trailer(ofmt_ctx);
 end:
 
-    avformat_close_input(&ifmt_ctx);
+    avio_mmap_close_input(&ifmt_ctx);
 
     /* close output */
     if (ofmt_ctx && !(ofmt->flags & AVFMT_NOFILE))
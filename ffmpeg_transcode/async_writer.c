@@ -0,0 +1,214 @@
+// pwrite()、ftruncate()、posix_memalign()，Makefile使用-std=c99编译
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include "async_writer.h"
+
+// 写线程：按提交顺序将写块写入文件，写完的块放回空闲队列。出错后不再写入，只回收写块
+static int writer_thread(void *arg) {
+    async_writer_t *w = arg;
+    async_block_t *blk = NULL;
+
+    while (av_queue_get(&w->full_queue, (void **)&blk, 1) == 1) {
+        int64_t t0 = av_gettime_relative();
+        int off = 0;
+        while (off < blk->size && SDL_AtomicGet(&w->err) == 0) {
+            ssize_t n = pwrite(w->fd, blk->data + off, blk->size - off, blk->pos + off);
+            if (n > 0) {
+                off += n;
+            } else if (n == 0 || errno != EINTR) {
+                SDL_AtomicSet(&w->err, n == 0 ? AVERROR(EIO) : AVERROR(errno));
+            }
+        }
+        stage_stat_add(&w->write_stat, av_gettime_relative() - t0);
+        av_queue_put(&w->free_queue, blk);
+    }
+
+    return 0;
+}
+
+// AVIOContext的写回调，在复用线程中调用：复制到空闲写块后提交给写线程
+static int write_packet(void *opaque, uint8_t *buf, int buf_size) {
+    async_writer_t *w = opaque;
+    int written = 0;
+    int ret;
+
+    while (written < buf_size) {
+        async_block_t *blk = NULL;
+        if ((ret = SDL_AtomicGet(&w->err)) < 0) {
+            return ret;
+        }
+        int64_t t0 = av_gettime_relative();
+        if ((ret = av_queue_get(&w->free_queue, (void **)&blk, 1)) < 0) {
+            return ret;
+        }
+        stage_stat_add(&w->wait_stat, av_gettime_relative() - t0);
+
+        blk->size = FFMIN(buf_size - written, ASYNC_WRITE_BLOCK_SIZE);
+        blk->pos = w->pos;
+        memcpy(blk->data, buf + written, blk->size);
+        written += blk->size;
+        w->pos += blk->size;
+        w->size = FFMAX(w->size, w->pos);
+        if ((ret = av_queue_put(&w->full_queue, blk)) < 0) {
+            return ret;
+        }
+    }
+
+    return buf_size;
+}
+
+// AVIOContext的seek回调，AVIOContext已先写出缓冲区中的数据
+static int64_t seek(void *opaque, int64_t offset, int whence) {
+    async_writer_t *w = opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return w->size;
+    case SEEK_SET:
+        w->pos = offset;
+        break;
+    case SEEK_CUR:
+        w->pos += offset;
+        break;
+    case SEEK_END:
+        w->pos = w->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    return w->pos;
+}
+
+// 1. 打开文件，续写时截掉append_pos之后的数据
+// 2. 分配对齐的写块，全部放入空闲队列
+// 3. 创建使用写回调的AVIOContext，启动写线程
+int async_writer_open(async_writer_t **writer, const char *filename, int64_t append_pos) {
+    async_writer_t *w = av_mallocz(sizeof(async_writer_t));
+    const char *path = filename;
+    uint8_t *io_buf;
+    int ret;
+
+    if (!w) {
+        return AVERROR(ENOMEM);
+    }
+    *writer = w;
+
+    // 1
+    av_strstart(filename, "file:", &path);
+    w->fd = open(path, O_WRONLY | O_CREAT | (append_pos > 0 ? 0 : O_TRUNC), 0666);
+    if (w->fd < 0) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'\n", filename);
+        return ret;
+    }
+    if (append_pos > 0 && ftruncate(w->fd, append_pos) != 0) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Cannot truncate '%s' to %"PRId64" bytes\n", filename, append_pos);
+        return ret;
+    }
+    w->pos = w->size = FFMAX(append_pos, 0);
+
+    // 2
+    if ((ret = av_queue_init(&w->full_queue, ASYNC_WRITE_BLOCKS)) < 0 ||
+        (ret = av_queue_init(&w->free_queue, ASYNC_WRITE_BLOCKS)) < 0) {
+        return ret;
+    }
+    for (int k = 0; k < ASYNC_WRITE_BLOCKS; k++) {
+        void *data = NULL;
+        if (posix_memalign(&data, ASYNC_WRITE_ALIGN, ASYNC_WRITE_BLOCK_SIZE) != 0) {
+            return AVERROR(ENOMEM);
+        }
+        w->blocks[k].data = data;
+        av_queue_put(&w->free_queue, &w->blocks[k]);
+    }
+
+    // 3
+    io_buf = av_malloc(ASYNC_WRITE_BLOCK_SIZE);
+    if (!io_buf) {
+        return AVERROR(ENOMEM);
+    }
+    w->pb = avio_alloc_context(io_buf, ASYNC_WRITE_BLOCK_SIZE, 1, w, NULL, write_packet, seek);
+    if (!w->pb) {
+        av_free(io_buf);
+        return AVERROR(ENOMEM);
+    }
+    w->pb->seekable = AVIO_SEEKABLE_NORMAL;
+    w->tid = SDL_CreateThread(writer_thread, "writer_thread", w);
+    if (!w->tid) {
+        av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+// 取回全部写块即说明已提交的写块都已写完，然后再放回空闲队列
+int async_writer_drain(async_writer_t *w) {
+    async_block_t *blks[ASYNC_WRITE_BLOCKS];
+    int nb_blks = 0;
+    int ret = 0;
+
+    avio_flush(w->pb);
+    while (nb_blks < ASYNC_WRITE_BLOCKS &&
+           (ret = av_queue_get(&w->free_queue, (void **)&blks[nb_blks], 1)) == 1) {
+        nb_blks++;
+    }
+    for (int k = 0; k < nb_blks; k++) {
+        av_queue_put(&w->free_queue, blks[k]);
+    }
+
+    return ret < 0 ? ret : SDL_AtomicGet(&w->err);
+}
+
+int async_writer_finish(async_writer_t *w) {
+    if (w->tid) {
+        avio_flush(w->pb);
+        av_queue_finish(&w->full_queue);
+        SDL_WaitThread(w->tid, NULL);
+        w->tid = NULL;
+    }
+    if (SDL_AtomicGet(&w->err) == 0 && w->pb->error < 0) {
+        SDL_AtomicSet(&w->err, w->pb->error);
+    }
+
+    return SDL_AtomicGet(&w->err);
+}
+
+void async_writer_free(async_writer_t **writer) {
+    async_writer_t *w = *writer;
+
+    if (!w) {
+        return;
+    }
+    if (w->tid) {
+        // 出错退出时写线程可能阻塞在写块队列上
+        av_queue_abort(&w->full_queue);
+        av_queue_abort(&w->free_queue);
+        SDL_WaitThread(w->tid, NULL);
+    }
+    av_queue_destroy(&w->full_queue, NULL);
+    av_queue_destroy(&w->free_queue, NULL);
+    for (int k = 0; k < ASYNC_WRITE_BLOCKS; k++) {
+        free(w->blocks[k].data);
+    }
+    if (w->pb) {
+        av_freep(&w->pb->buffer);
+        avio_context_free(&w->pb);
+    }
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    av_freep(writer);
+}
@@ -0,0 +1,50 @@
+#ifndef __ASYNC_WRITER_H__
+#define __ASYNC_WRITER_H__
+
+#include <stdint.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_thread.h>
+#include <libavformat/avio.h>
+#include "av_queue.h"
+#include "av_stats.h"
+
+// 写块大小及个数。AVIOContext的缓冲区与写块大小相同，复用器的输出按块交给写线程
+#define ASYNC_WRITE_BLOCK_SIZE  (1 << 20)
+#define ASYNC_WRITE_BLOCKS      8
+// 写块按此对齐分配，大小也是其整数倍
+#define ASYNC_WRITE_ALIGN       4096
+
+// 一块待写入文件的数据
+typedef struct {
+    uint8_t *data;
+    int size;
+    int64_t pos;                    // 写入文件的偏移
+}   async_block_t;
+
+// 异步文件写：复用器写AVIOContext时只把数据复制到空闲的写块中，由单独的写线程按偏移写入文件
+// 磁盘或NFS写入延迟抖动时，复用线程(以及其上游的编码线程)不被阻塞，除非全部写块都在等待写入
+// 写入使用pwrite()，复用器的seek只改变逻辑写位置，不需要等待已提交的写块写完
+typedef struct {
+    AVIOContext *pb;                // 交给AVFormatContext.pb使用
+    int fd;
+    async_block_t blocks[ASYNC_WRITE_BLOCKS];
+    av_queue_t full_queue;          // mux -> writer, async_block_t *
+    av_queue_t free_queue;          // writer -> mux, async_block_t *
+    SDL_Thread *tid;
+    int64_t pos;                    // 逻辑写位置，由复用线程维护
+    int64_t size;                   // 逻辑文件长度
+    SDL_atomic_t err;               // 写线程第一次出错的错误码
+
+    stage_stat_t write_stat;        // 每个写块的pwrite()耗时，由写线程更新
+    stage_stat_t wait_stat;         // 复用线程等待空闲写块的耗时，由复用线程更新
+}   async_writer_t;
+
+// append_pos大于0时保留已有文件的前append_pos字节，从此处续写；否则新建或清空文件
+int async_writer_open(async_writer_t **writer, const char *filename, int64_t append_pos);
+// 写出AVIOContext中剩余的数据并等待已提交的写块全部写完，写线程继续运行。返回写入过程中的第一个错误
+int async_writer_drain(async_writer_t *writer);
+// 写出AVIOContext中剩余的数据，等待全部写块写完后结束写线程，返回写入过程中的第一个错误
+int async_writer_finish(async_writer_t *writer);
+void async_writer_free(async_writer_t **writer);
+
+#endif
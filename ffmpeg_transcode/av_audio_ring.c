@@ -0,0 +1,147 @@
+#include <string.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include "av_audio_ring.h"
+
+// 读出帧数据缓冲区按此字节数对齐并留出余量，与av_frame_get_buffer()一致，编码器的SIMD代码可能越界读取
+#define RING_FRAME_ALIGN    64
+
+// max_frame_size为读出帧的最大采样点数，capacity为单个声道可缓存的采样点数，capacity不小于max_frame_size
+av_audio_ring_t *av_audio_ring_alloc(enum AVSampleFormat sample_fmt, int channels,
+                                     int max_frame_size, int capacity) {
+    av_audio_ring_t *ring;
+    int planar = av_sample_fmt_is_planar(sample_fmt);
+
+    if (channels <= 0 || max_frame_size <= 0 || capacity < max_frame_size) {
+        return NULL;
+    }
+    ring = av_mallocz(sizeof(av_audio_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+    ring->nb_planes = planar ? channels : 1;
+    ring->sample_size = av_get_bytes_per_sample(sample_fmt) * (planar ? 1 : channels);
+    ring->capacity = capacity;
+    ring->max_frame_size = max_frame_size;
+    ring->next_pts = AV_NOPTS_VALUE;
+
+    // 所有plane使用一块连续内存
+    ring->planes = av_mallocz_array(ring->nb_planes, sizeof(uint8_t *));
+    if (!ring->planes) {
+        goto fail;
+    }
+    ring->planes[0] = av_malloc_array(ring->nb_planes, (size_t)capacity * ring->sample_size);
+    if (!ring->planes[0]) {
+        goto fail;
+    }
+    for (int i = 1; i < ring->nb_planes; i++) {
+        ring->planes[i] = ring->planes[0] + (size_t)i * capacity * ring->sample_size;
+    }
+
+    ring->buf_pool = av_buffer_pool_init(FFALIGN(max_frame_size * ring->sample_size, RING_FRAME_ALIGN) +
+                                         RING_FRAME_ALIGN, NULL);
+    if (!ring->buf_pool) {
+        goto fail;
+    }
+
+    return ring;
+
+fail:
+    av_audio_ring_free(&ring);
+    return NULL;
+}
+
+void av_audio_ring_free(av_audio_ring_t **ring) {
+    av_audio_ring_t *r = *ring;
+    if (!r) {
+        return;
+    }
+    if (r->planes) {
+        av_free(r->planes[0]);
+    }
+    av_free(r->planes);
+    // 已读出帧仍持有的缓冲区在其释放后才真正释放
+    av_buffer_pool_uninit(&r->buf_pool);
+    av_freep(ring);
+}
+
+int av_audio_ring_size(const av_audio_ring_t *ring) {
+    return ring->size;
+}
+
+// 将frame中从第offset个采样点开始的数据写入环形缓冲区，缓冲区剩余空间不足时只写入一部分
+// 第一次写入时以frame->pts作为第一个读出帧的pts
+// return >=0:  number of samples written
+int av_audio_ring_write(av_audio_ring_t *ring, const AVFrame *frame, int offset) {
+    int nb_samples = FFMIN(frame->nb_samples - offset, ring->capacity - ring->size);
+    int windex = (ring->rindex + ring->size) % ring->capacity;
+    // 写入区间在缓冲区尾部回绕时分两段拷贝
+    int n1 = FFMIN(nb_samples, ring->capacity - windex);
+    int n2 = nb_samples - n1;
+
+    if (nb_samples <= 0) {
+        return 0;
+    }
+    if (ring->next_pts == AV_NOPTS_VALUE) {
+        ring->next_pts = (frame->pts != AV_NOPTS_VALUE) ? frame->pts + offset : 0;
+    }
+
+    for (int i = 0; i < ring->nb_planes; i++) {
+        const uint8_t *src = frame->extended_data[i] + (size_t)offset * ring->sample_size;
+        memcpy(ring->planes[i] + (size_t)windex * ring->sample_size, src, (size_t)n1 * ring->sample_size);
+        if (n2 > 0) {
+            memcpy(ring->planes[i], src + (size_t)n1 * ring->sample_size, (size_t)n2 * ring->sample_size);
+        }
+    }
+    ring->size += nb_samples;
+
+    return nb_samples;
+}
+
+// 读出nb_samples个采样点到frame，nb_samples不大于max_frame_size和缓存的采样点数
+// 调用者需先设置frame的format、channel_layout、channels、sample_rate，frame中不能有数据缓冲区
+// return 0:    success
+int av_audio_ring_read(av_audio_ring_t *ring, AVFrame *frame, int nb_samples) {
+    int n1 = FFMIN(nb_samples, ring->capacity - ring->rindex);
+    int n2 = nb_samples - n1;
+    int ret;
+
+    if (nb_samples <= 0 || nb_samples > ring->max_frame_size || nb_samples > ring->size) {
+        return AVERROR(EINVAL);
+    }
+
+    frame->nb_samples = nb_samples;
+    if (ring->nb_planes <= AV_NUM_DATA_POINTERS) {
+        for (int i = 0; i < ring->nb_planes; i++) {
+            frame->buf[i] = av_buffer_pool_get(ring->buf_pool);
+            if (!frame->buf[i]) {
+                return AVERROR(ENOMEM);
+            }
+            frame->data[i] = frame->buf[i]->data;
+        }
+        frame->extended_data = frame->data;
+        frame->linesize[0] = nb_samples * ring->sample_size;
+    } else if ((ret = av_frame_get_buffer(frame, 0)) < 0) {
+        // plane数超过AVFrame.buf[]的容量，需要extended_buf，此时退回普通分配
+        return ret;
+    }
+
+    for (int i = 0; i < ring->nb_planes; i++) {
+        const uint8_t *src = ring->planes[i];
+        memcpy(frame->extended_data[i], src + (size_t)ring->rindex * ring->sample_size,
+               (size_t)n1 * ring->sample_size);
+        if (n2 > 0) {
+            memcpy(frame->extended_data[i] + (size_t)n1 * ring->sample_size, src,
+                   (size_t)n2 * ring->sample_size);
+        }
+    }
+    ring->rindex = (ring->rindex + nb_samples) % ring->capacity;
+    ring->size -= nb_samples;
+
+    frame->pts = ring->next_pts;
+    ring->next_pts += nb_samples;
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __AV_AUDIO_RING_H__
+#define __AV_AUDIO_RING_H__
+
+#include <stdint.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+
+// 编码器帧尺寸适配用的音频环形缓冲区，替代AVAudioFifo
+// 容量在创建时固定，写入时直接拷贝到环形缓冲区中，不再随每个解码帧realloc；读出的编码器帧的数据缓冲区
+// 取自AVBufferPool，编码器释放引用后缓冲区自动回到池中，稳定运行后音频路径上没有逐帧的大块内存分配
+// 读出帧的pts按采样点数累加得到，单位是采样率的倒数，与音频编码器时基相同
+typedef struct {
+    uint8_t **planes;               // 每个plane一段环形缓冲区，packed格式只有一个plane
+    int nb_planes;
+    int sample_size;                // 单个plane中一个采样点的字节数
+    int capacity;                   // 单个声道可缓存的采样点数
+    int rindex;                     // 读位置，单位是采样点
+    int size;                       // 缓存的采样点数
+    int max_frame_size;             // 读出帧的最大采样点数，即编码器帧尺寸
+    AVBufferPool *buf_pool;         // 读出帧每个plane的数据缓冲区
+    int64_t next_pts;               // 下一个读出帧的pts，AV_NOPTS_VALUE表示尚未写入数据
+}   av_audio_ring_t;
+
+av_audio_ring_t *av_audio_ring_alloc(enum AVSampleFormat sample_fmt, int channels,
+                                     int max_frame_size, int capacity);
+void av_audio_ring_free(av_audio_ring_t **ring);
+int av_audio_ring_size(const av_audio_ring_t *ring);
+int av_audio_ring_write(av_audio_ring_t *ring, const AVFrame *frame, int offset);
+int av_audio_ring_read(av_audio_ring_t *ring, AVFrame *frame, int nb_samples);
+
+#endif
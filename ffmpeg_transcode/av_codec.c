@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdbool.h>
 #include "av_codec.h"
 
@@ -124,3 +125,17 @@ int av_encode_frame(AVCodecContext *enc_ctx, AVFrame *frame, AVPacket *packet) {
     
     return ret;
 }
+
+void av_packet_fix_seam_dts(AVPacket *packet, int64_t *last_dts) {
+    if (packet->dts != AV_NOPTS_VALUE && *last_dts != AV_NOPTS_VALUE && packet->dts <= *last_dts) {
+        av_log(NULL, AV_LOG_WARNING, "stream %d: non-increasing dts %"PRId64" after %"PRId64" at seam, adjusted\n",
+               packet->stream_index, packet->dts, *last_dts);
+        packet->dts = *last_dts + 1;
+        if (packet->pts != AV_NOPTS_VALUE && packet->pts < packet->dts) {
+            packet->pts = packet->dts;
+        }
+    }
+    if (packet->dts != AV_NOPTS_VALUE) {
+        *last_dts = packet->dts;
+    }
+}
@@ -7,6 +7,9 @@
 
 int av_decode_frame(AVCodecContext *dec_ctx, AVPacket *packet, bool *new_packet, AVFrame *frame);
 int av_encode_frame(AVCodecContext *enc_ctx, AVFrame *frame, AVPacket *packet);
+// 拼接多段码流时保证同一流的dts严格递增：dts不大于*last_dts时改为*last_dts+1(pts随之不小于dts)并打印警告，
+// 然后用packet的dts更新*last_dts。*last_dts初值为AV_NOPTS_VALUE
+void av_packet_fix_seam_dts(AVPacket *packet, int64_t *last_dts);
 
 #endif
 
@@ -0,0 +1,121 @@
+#include <stdbool.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/log.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include "av_dedup.h"
+
+// 未启用pixelutils的libavutil使用的8x8块SAD
+static int sad_8x8_c(const uint8_t *src1, ptrdiff_t stride1, const uint8_t *src2, ptrdiff_t stride2) {
+    int sum = 0;
+
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            sum += abs(src1[x] - src2[x]);
+        }
+        src1 += stride1;
+        src2 += stride2;
+    }
+
+    return sum;
+}
+
+av_dedup_t *av_dedup_alloc(void) {
+    av_dedup_t *d = av_mallocz(sizeof(av_dedup_t));
+    if (!d) {
+        return NULL;
+    }
+    d->ref = av_frame_alloc();
+    d->tail = av_frame_alloc();
+    if (!d->ref || !d->tail) {
+        av_dedup_free(&d);
+        return NULL;
+    }
+    // 解码帧的各行不保证按块对齐，使用不要求对齐的版本
+    d->sad = av_pixelutils_get_sad_fn(3, 3, 0, NULL);
+    if (!d->sad) {
+        d->sad = sad_8x8_c;
+    }
+
+    return d;
+}
+
+void av_dedup_free(av_dedup_t **dedup) {
+    av_dedup_t *d = *dedup;
+    if (!d) {
+        return;
+    }
+    av_frame_free(&d->ref);
+    av_frame_free(&d->tail);
+    av_freep(dedup);
+}
+
+static bool is_comparable(const AVFrame *a, const AVFrame *b) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+
+    return desc && !(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)) &&
+           a->format == b->format && a->width == b->width && a->height == b->height;
+}
+
+// 逐plane按8x8块比较，宽高不足8的边缘部分不参与比较。一旦确定不重复即返回
+static bool is_duplicate(const av_dedup_t *d, const AVFrame *cur, const AVFrame *ref) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(cur->format);
+    int nb_planes = av_pix_fmt_count_planes(cur->format);
+
+    for (int p = 0; p < nb_planes; p++) {
+        // 按字节比较，packed格式的各分量在同一plane中
+        int w = av_image_get_linesize(cur->format, cur->width, p);
+        int h = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(cur->height, desc->log2_chroma_h) : cur->height;
+        int max_lo = (int)((w / 8) * (h / 8) * DEDUP_FRAC);
+        int nb_lo = 0;
+
+        for (int y = 0; y + 8 <= h; y += 8) {
+            const uint8_t *s1 = cur->data[p] + (ptrdiff_t)y * cur->linesize[p];
+            const uint8_t *s2 = ref->data[p] + (ptrdiff_t)y * ref->linesize[p];
+            for (int x = 0; x + 8 <= w; x += 8) {
+                int sad = d->sad(s1 + x, cur->linesize[p], s2 + x, ref->linesize[p]);
+                if (sad > DEDUP_HI || (sad > DEDUP_LO && ++nb_lo > max_lo)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// 1. 与上一个保留的帧比较，重复帧移入tail，替换之前被丢弃的帧
+// 2. 保留的帧成为新的比较基准，之前被丢弃的帧已被此帧覆盖，不再需要
+int av_dedup_filter(av_dedup_t *dedup, AVFrame *frame) {
+    int ret;
+
+    // 1
+    if (dedup->ref->data[0] && is_comparable(frame, dedup->ref) && is_duplicate(dedup, frame, dedup->ref)) {
+        av_frame_unref(dedup->tail);
+        av_frame_move_ref(dedup->tail, frame);
+        dedup->nb_dropped++;
+        return 1;
+    }
+
+    // 2
+    av_frame_unref(dedup->tail);
+    av_frame_unref(dedup->ref);
+    if ((ret = av_frame_ref(dedup->ref, frame)) < 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+int av_dedup_flush(av_dedup_t *dedup, AVFrame *frame) {
+    av_frame_unref(dedup->ref);
+    if (!dedup->tail->data[0]) {
+        return 0;
+    }
+    av_frame_move_ref(frame, dedup->tail);
+    dedup->nb_dropped--;
+
+    return 1;
+}
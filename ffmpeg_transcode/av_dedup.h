@@ -0,0 +1,31 @@
+#ifndef __AV_DEDUP_H__
+#define __AV_DEDUP_H__
+
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixelutils.h>
+
+// 判定重复帧的阈值，与mpdecimate滤镜的默认值相同：按8x8块计算与上一保留帧的SAD，
+// 任一块超过DEDUP_HI，或超过DEDUP_LO的块多于本plane块数的DEDUP_FRAC，则不是重复帧
+#define DEDUP_HI            (64 * 12)
+#define DEDUP_LO            (64 * 5)
+#define DEDUP_FRAC          0.33
+
+// 编码前的重复帧消除，用于屏幕录制等大部分时间静止的内容
+// 与上一个保留的帧几乎相同的帧被丢弃，保留帧的pts不变，输出即为可变帧率，被丢弃帧的时长并入前一帧
+// 块SAD使用libavutil的pixelutils，有SIMD实现。硬件帧、调色板等格式不比较，所有帧都保留
+typedef struct {
+    av_pixelutils_sad_fn sad;
+    AVFrame *ref;                   // 上一个保留的帧，只持有引用
+    AVFrame *tail;                  // 上一个保留帧之后最近被丢弃的帧，流结束时输出，保证输出时长不变
+    int64_t nb_dropped;             // 丢弃的帧数
+}   av_dedup_t;
+
+av_dedup_t *av_dedup_alloc(void);
+void av_dedup_free(av_dedup_t **dedup);
+// 返回0表示保留frame；返回1表示frame是重复帧，其数据已移入dedup，frame变为空帧；返回负值表示出错
+int av_dedup_filter(av_dedup_t *dedup, AVFrame *frame);
+// 流结束时取出最后被丢弃的帧，返回1表示frame中是取出的帧，返回0表示没有
+int av_dedup_flush(av_dedup_t *dedup, AVFrame *frame);
+
+#endif
@@ -32,17 +32,65 @@ void get_filter_iafmt(const inout_ctx_t *ictx, int stream_idx, filter_iafmt_t *i
 void get_filter_oafmt(const inout_ctx_t *octx, int stream_idx, filter_oafmt_t *oafmt) {
 }
 
+// 创建nb_outputs个buffersink滤镜实例，作为滤镜图的输出，并生成与之连接的端点链表inputs
+// 只有一个输出时命名为"out"，否则依次命名为"out0"、"out1"...
+static int create_bufsinks(filter_ctx_t *fctx, const char *sink_name, int nb_outputs,
+                           AVFilterInOut **inputs) {
+    const AVFilter *bufsink = avfilter_get_by_name(sink_name);
+    int ret;
+
+    if (nb_outputs < 1 || nb_outputs > MAX_FILTER_OUTPUTS) {
+        return AVERROR(EINVAL);
+    }
+
+    *inputs = NULL;
+    for (int i = nb_outputs - 1; i >= 0; i--) {
+        char name[16];
+        if (nb_outputs == 1) {
+            snprintf(name, sizeof(name), "out");
+        } else {
+            snprintf(name, sizeof(name), "out%d", i);
+        }
+
+        // 为buffersink滤镜创建滤镜实例，将其添加到滤镜图filter_graph中
+        ret = avfilter_graph_create_filter(&fctx->bufsink_ctxs[i], bufsink, name,
+                                           NULL, NULL, fctx->filter_graph);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
+            return ret;
+        }
+
+        // inputs变量意指buffersink滤镜的输入引脚(input pad)，与filters_descr中同标号的输出相连
+        AVFilterInOut *in = avfilter_inout_alloc();
+        if (!in) {
+            return AVERROR(ENOMEM);
+        }
+        in->name       = av_strdup(name);
+        in->filter_ctx = fctx->bufsink_ctxs[i];
+        in->pad_idx    = 0;
+        in->next       = *inputs;
+        *inputs = in;
+    }
+    fctx->nb_bufsinks = nb_outputs;
+
+    return 0;
+}
 
 // 创建配置一个滤镜图，在后续滤镜处理中，可以往此滤镜图输入数据并从滤镜图获得输出数据
 // @filters_descr: I, 以字符串形式描述的滤镜图，形如"transpose=cclock,pad=iw*2:ih"
 // @ivfmt:         I, 输入图像格式，用于设置滤镜图输入节点(buffer滤镜)
-// @ovfmt:         I, 输出像素格式，用于设置滤镜图输出节点(buffersink滤镜)。
+// @ovfmts:        I, 每个输出的像素格式，用于设置滤镜图输出节点(buffersink滤镜)。
 //                    数组形式，以-1标识有效元素结束，形如{AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGB24, -1}
+// @nb_outputs:    I, 滤镜图输出个数，即ovfmts数组大小
 // @fctx:          O, 配置好的 filter context
 int init_video_filters(const char *filters_descr, 
                        const filter_ivfmt_t *ivfmt, 
-                       const filter_ovfmt_t *ovfmt,
+                       const filter_ovfmt_t *ovfmts,
+                       int nb_outputs,
+                       int nb_threads,
                        filter_ctx_t *fctx) {
+    AVFilterInOut *outputs = NULL;
+    AVFilterInOut *inputs  = NULL;
     int ret = 0;
 
     // 分配一个滤镜图filter_graph
@@ -51,6 +99,8 @@ int init_video_filters(const char *filters_descr,
         ret = AVERROR(ENOMEM);
         goto end;
     }
+    // 线程数在创建第一个滤镜时生效，需在此之前设置
+    fctx->filter_graph->nb_threads = nb_threads;
 
     char args[512];
     char *p_args = NULL;
@@ -77,23 +127,20 @@ int init_video_filters(const char *filters_descr,
     }
 
     // buffersink滤镜：缓冲视频帧，作为滤镜图的输出
-    const AVFilter *bufsink = avfilter_get_by_name("buffersink");
     /* buffer video sink: to terminate the filter chain. */
-    // 为buffersink滤镜创建滤镜实例buffersink_ctx，命名为"out"
-    // 将新创建的滤镜实例buffersink_ctx添加到滤镜图filter_graph中
-    ret = avfilter_graph_create_filter(&fctx->bufsink_ctx, bufsink, "out",
-                                       NULL, NULL, fctx->filter_graph);
+    ret = create_bufsinks(fctx, "buffersink", nb_outputs, &inputs);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
         goto end;
     }
 
     // 设置输出像素格式为pix_fmts[]中指定的格式(如果要用SDL显示，则这些格式应是SDL支持格式)
-    ret = av_opt_set_int_list(fctx->bufsink_ctx, "pix_fmts", ovfmt->pix_fmts,
-                              AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot set output pixel format\n");
-        goto end;
+    for (int i = 0; i < nb_outputs; i++) {
+        ret = av_opt_set_int_list(fctx->bufsink_ctxs[i], "pix_fmts", ovfmts[i].pix_fmts,
+                                  AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set output pixel format\n");
+            goto end;
+        }
     }
 
     /*
@@ -113,7 +160,11 @@ int init_video_filters(const char *filters_descr,
     // src缓冲区(buffersrc_ctx滤镜)的输出必须连到filters_descr中第一个
     // 滤镜的输入；filters_descr中第一个滤镜的输入标号未指定，故默认为
     // "in"，此处将buffersrc_ctx的输出标号也设为"in"，就实现了同标号相连
-    AVFilterInOut *outputs = avfilter_inout_alloc();
+    outputs = avfilter_inout_alloc();
+    if (!outputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
     outputs->name       = av_strdup("in");
     outputs->filter_ctx = fctx->bufsrc_ctx;
     outputs->pad_idx    = 0;
@@ -125,16 +176,11 @@ int init_video_filters(const char *filters_descr,
      * filter output label is not specified, it is set to "out" by
      * default.
      */
-    // inputs变量意指buffersink_ctx滤镜的输入引脚(input pad)
+    // inputs变量意指buffersink_ctx滤镜的输入引脚(input pad)，已在create_bufsinks()中创建
     // sink缓冲区(buffersink_ctx滤镜)的输入必须连到filters_descr中最后
     // 一个滤镜的输出；filters_descr中最后一个滤镜的输出标号未指定，故
     // 默认为"out"，此处将buffersink_ctx的输出标号也设为"out"，就实现了
-    // 同标号相连
-    AVFilterInOut *inputs  = avfilter_inout_alloc();
-    inputs->name       = av_strdup("out");
-    inputs->filter_ctx = fctx->bufsink_ctx;
-    inputs->pad_idx    = 0;
-    inputs->next       = NULL;
+    // 同标号相连。多个输出时filters_descr须显式标出"out0"、"out1"...
 
     // 将filters_descr描述的滤镜图添加到filter_graph滤镜图中
     // 调用前：filter_graph包含两个滤镜buffersrc_ctx和buffersink_ctx
@@ -165,13 +211,18 @@ end:
 // 创建配置一个滤镜图，在后续滤镜处理中，可以往此滤镜图输入数据并从滤镜图获得输出数据
 // @filters_descr: I, 以字符串形式描述的滤镜图，形如""
 // @afmt:          I, 输入声音格式，用于设置滤镜图输入节点(abuffer滤镜)
-// @pix_fmts:      I, 输出像素格式，用于设置滤镜图输出节点(abuffersink滤镜)。
-//                    数组形式，以-1标识有效元素结束，形如{AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGB24, -1}
+// @oafmts:        I, 每个输出的声音格式，用于设置滤镜图输出节点(abuffersink滤镜)。
+//                    各成员均为数组形式，以-1标识有效元素结束
+// @nb_outputs:    I, 滤镜图输出个数，即oafmts数组大小
 // @fctx:          O, 配置好的 filter context
 int init_audio_filters(const char *filters_descr, 
                        const filter_iafmt_t *iafmt, 
-                       const filter_oafmt_t *oafmt, 
+                       const filter_oafmt_t *oafmts, 
+                       int nb_outputs,
+                       int nb_threads,
                        filter_ctx_t *fctx) {
+    AVFilterInOut *outputs = NULL;
+    AVFilterInOut *inputs  = NULL;
     int ret = 0;
 
     // 分配一个滤镜图filter_graph
@@ -180,6 +231,8 @@ int init_audio_filters(const char *filters_descr,
         ret = AVERROR(ENOMEM);
         goto end;
     }
+    // 线程数在创建第一个滤镜时生效，需在此之前设置
+    fctx->filter_graph->nb_threads = nb_threads;
 
     char args[512];
     char *p_args = NULL;
@@ -206,38 +259,35 @@ int init_audio_filters(const char *filters_descr,
     }
 
     // buffersink滤镜：缓冲音频帧，作为滤镜图的输出
-    const AVFilter *bufsink = avfilter_get_by_name("abuffersink");
-    /* buffer video sink: to terminate the filter chain. */
-    // 为buffersink滤镜创建滤镜实例buffersink_ctx，命名为"out"
-    // 将新创建的滤镜实例buffersink_ctx添加到滤镜图filter_graph中
-    ret = avfilter_graph_create_filter(&fctx->bufsink_ctx, bufsink, "out",
-                                       NULL, NULL, fctx->filter_graph);
+    /* buffer audio sink: to terminate the filter chain. */
+    ret = create_bufsinks(fctx, "abuffersink", nb_outputs, &inputs);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
         goto end;
     }
 
-
-    ret = av_opt_set_int_list(fctx->bufsink_ctx, "sample_fmts",
-            oafmt->sample_fmts, -1, AV_OPT_SEARCH_CHILDREN);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot set output sample format\n");
-        goto end;
-    }
-    
-    // 将输出声道布局设置为编码器采用的声道布局
-    ret = av_opt_set_int_list(fctx->bufsink_ctx, "channel_layouts",
-            oafmt->channel_layouts, -1, AV_OPT_SEARCH_CHILDREN);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot set output channel layout\n");
-        goto end;
-    }
-    
-    ret = av_opt_set_int_list(fctx->bufsink_ctx, "sample_rates",
-            oafmt->sample_rates, -1, AV_OPT_SEARCH_CHILDREN);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot set output sample rate\n");
-        goto end;
+    for (int i = 0; i < nb_outputs; i++) {
+        const filter_oafmt_t *oafmt = &oafmts[i];
+        ret = av_opt_set_int_list(fctx->bufsink_ctxs[i], "sample_fmts",
+                oafmt->sample_fmts, -1, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set output sample format\n");
+            goto end;
+        }
+
+        // 将输出声道布局设置为编码器采用的声道布局
+        ret = av_opt_set_int_list(fctx->bufsink_ctxs[i], "channel_layouts",
+                oafmt->channel_layouts, -1, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set output channel layout\n");
+            goto end;
+        }
+
+        ret = av_opt_set_int_list(fctx->bufsink_ctxs[i], "sample_rates",
+                oafmt->sample_rates, -1, AV_OPT_SEARCH_CHILDREN);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set output sample rate\n");
+            goto end;
+        }
     }
 
     /*
@@ -257,7 +307,11 @@ int init_audio_filters(const char *filters_descr,
     // src缓冲区(buffersrc_ctx滤镜)的输出必须连到filters_descr中第一个
     // 滤镜的输入；filters_descr中第一个滤镜的输入标号未指定，故默认为
     // "in"，此处将buffersrc_ctx的输出标号也设为"in"，就实现了同标号相连
-    AVFilterInOut *outputs = avfilter_inout_alloc();
+    outputs = avfilter_inout_alloc();
+    if (!outputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
     outputs->name       = av_strdup("in");
     outputs->filter_ctx = fctx->bufsrc_ctx;
     outputs->pad_idx    = 0;
@@ -269,16 +323,11 @@ int init_audio_filters(const char *filters_descr,
      * filter output label is not specified, it is set to "out" by
      * default.
      */
-    // inputs变量意指buffersink_ctx滤镜的输入引脚(input pad)
+    // inputs变量意指buffersink_ctx滤镜的输入引脚(input pad)，已在create_bufsinks()中创建
     // sink缓冲区(buffersink_ctx滤镜)的输入必须连到filters_descr中最后
     // 一个滤镜的输出；filters_descr中最后一个滤镜的输出标号未指定，故
     // 默认为"out"，此处将buffersink_ctx的输出标号也设为"out"，就实现了
-    // 同标号相连
-    AVFilterInOut *inputs  = avfilter_inout_alloc();
-    inputs->name       = av_strdup("out");
-    inputs->filter_ctx = fctx->bufsink_ctx;
-    inputs->pad_idx    = 0;
-    inputs->next       = NULL;
+    // 同标号相连。多个输出时filters_descr须显式标出"out0"、"out1"...
 
     // 将filters_descr描述的滤镜图添加到filter_graph滤镜图中
     // 调用前：filter_graph包含两个滤镜buffersrc_ctx和buffersink_ctx
@@ -314,24 +363,61 @@ int deinit_filters(filter_ctx_t *fctx) {
     return 0;
 }
 
+int probe_video_filters(const char *filters_descr, const filter_ivfmt_t *ivfmt, int *width, int *height) {
+    enum AVPixelFormat pix_fmts[] = { AV_PIX_FMT_NONE };   // 不限制输出像素格式
+    filter_ovfmt_t ovfmt = { pix_fmts };
+    filter_ctx_t fctx = { 0 };
+
+    int ret = init_video_filters(filters_descr, ivfmt, &ovfmt, 1, 1, &fctx);
+    if (ret >= 0) {
+        *width = av_buffersink_get_w(fctx.bufsink_ctxs[0]);
+        *height = av_buffersink_get_h(fctx.bufsink_ctxs[0]);
+    }
+    deinit_filters(&fctx);
+
+    return ret;
+}
+
+// 将frame送入filtergraph，frame为NULL表示冲洗滤镜
+int filtering_send_frame(const filter_ctx_t *fctx, AVFrame *frame) {
+    int ret = av_buffersrc_add_frame_flags(fctx->bufsrc_ctx, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
+    }
+
+    return ret;
+}
+
+// 从filtergraph的第sink_idx个输出获取经过处理的frame，一次输入可能对应零到多次输出，
+// 应循环调用直到返回AVERROR(EAGAIN)
+// retrun 0:                got a frame success
+//        AVERROR(EAGAIN):  need more frames
+//        AVERROR_EOF:      filter has been flushed
+//        <0:               error
+int filtering_receive_frame(const filter_ctx_t *fctx, int sink_idx, AVFrame *frame) {
+    int ret = av_buffersink_get_frame(fctx->bufsink_ctxs[sink_idx], frame);
+    if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        av_log(NULL, AV_LOG_WARNING, "filter error %d\n", ret);
+    }
+
+    return ret;
+}
+
 int filtering_frame(const filter_ctx_t *fctx, AVFrame *frame_in, AVFrame *frame_out) {
     int ret = 1;
     
     // 将frame送入filtergraph
-    ret = av_buffersrc_add_frame_flags(fctx->bufsrc_ctx, frame_in, AV_BUFFERSRC_FLAG_KEEP_REF);
+    ret = filtering_send_frame(fctx, frame_in);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
         return ret;
     }
     
     // 从filtergraph获取经过处理的frame
-    ret = av_buffersink_get_frame(fctx->bufsink_ctx, frame_out);
+    ret = filtering_receive_frame(fctx, 0, frame_out);
     if (ret == AVERROR_EOF) {
         av_log(NULL, AV_LOG_WARNING, "filter flushed\n");
     } else if (ret == AVERROR(EAGAIN)) {
         av_log(NULL, AV_LOG_WARNING, "filter need more frames\n");
-    } else if (ret < 0) {
-        av_log(NULL, AV_LOG_WARNING, "filter error %d\n", ret);
     }
 
     return ret;
@@ -9,8 +9,14 @@
 #include <libavformat/avformat.h>
 #include "open_file.h"
 
+// 一个滤镜图最多的输出个数
+#define MAX_FILTER_OUTPUTS  8
+
+// 滤镜图有一个输入和nb_bufsinks个输出。只有一个输出时，filters_descr的输出标号为"out"；
+// 有多个输出时(如split滤镜)，filters_descr的各输出标号依次为"out0"、"out1"...
 typedef struct {
-    AVFilterContext *bufsink_ctx;
+    AVFilterContext *bufsink_ctxs[MAX_FILTER_OUTPUTS];
+    int             nb_bufsinks;
     AVFilterContext *bufsrc_ctx;
     AVFilterGraph   *filter_graph;
 }   filter_ctx_t;
@@ -44,14 +50,19 @@ typedef struct {
     uint64_t *channel_layouts;
 }   filter_oafmt_t;
 
+// nb_threads为滤镜图的线程数(AVFilterGraph.nb_threads)，0表示由库决定
 int init_video_filters(const char *filters_descr, const filter_ivfmt_t *ivfmt, 
-                       const filter_ovfmt_t *ovfmt, filter_ctx_t *fctx);
+                       const filter_ovfmt_t *ovfmts, int nb_outputs, int nb_threads, filter_ctx_t *fctx);
 int init_audio_filters(const char *filters_descr, const filter_iafmt_t *ivfmt, 
-                       const filter_oafmt_t *ovfmt, filter_ctx_t *fctx);
+                       const filter_oafmt_t *ovfmts, int nb_outputs, int nb_threads, filter_ctx_t *fctx);
 int deinit_filters(filter_ctx_t *fctx);
+// 配置一次只有filters_descr的单输出滤镜图，取其输出图像尺寸后释放，用于在打开编码器之前确定编码尺寸
+int probe_video_filters(const char *filters_descr, const filter_ivfmt_t *ivfmt, int *width, int *height);
 void get_filter_ivfmt(const inout_ctx_t *ictx, int stream_idx, filter_ivfmt_t *ivfmt);
 void get_filter_iafmt(const inout_ctx_t *ictx, int stream_idx, filter_iafmt_t *iafmt);
 int filtering_frame(const filter_ctx_t *fctx, AVFrame *frame_in, AVFrame *frame_out);
+int filtering_send_frame(const filter_ctx_t *fctx, AVFrame *frame);
+int filtering_receive_frame(const filter_ctx_t *fctx, int sink_idx, AVFrame *frame);
 
 #endif
 
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+#include "av_pool.h"
+
+static void *frame_alloc(void) {
+    return av_frame_alloc();
+}
+
+static void frame_reset(void *item) {
+    av_frame_unref(item);
+}
+
+static void frame_free(void *item) {
+    AVFrame *frame = item;
+    av_frame_free(&frame);
+}
+
+static void *packet_alloc(void) {
+    return av_packet_alloc();
+}
+
+static void packet_reset(void *item) {
+    av_packet_unref(item);
+}
+
+static void packet_free(void *item) {
+    AVPacket *pkt = item;
+    av_packet_free(&pkt);
+}
+
+static int av_pool_init(av_pool_t *pool, int capacity) {
+    pool->items = av_mallocz_array(capacity, sizeof(void *));
+    if (!pool->items) {
+        return AVERROR(ENOMEM);
+    }
+    pool->capacity = capacity;
+
+    pool->mutex = SDL_CreateMutex();
+    if (!pool->mutex) {
+        av_log(NULL, AV_LOG_ERROR, "Create pool mutex failed: %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+int av_pool_init_frame(av_pool_t *pool, int capacity) {
+    memset(pool, 0, sizeof(av_pool_t));
+    pool->alloc_item = frame_alloc;
+    pool->reset_item = frame_reset;
+    pool->free_item = frame_free;
+    return av_pool_init(pool, capacity);
+}
+
+int av_pool_init_packet(av_pool_t *pool, int capacity) {
+    memset(pool, 0, sizeof(av_pool_t));
+    pool->alloc_item = packet_alloc;
+    pool->reset_item = packet_reset;
+    pool->free_item = packet_free;
+    return av_pool_init(pool, capacity);
+}
+
+void av_pool_destroy(av_pool_t *pool) {
+    if (pool->items) {
+        for (int i = 0; i < pool->nb_items; i++) {
+            pool->free_item(pool->items[i]);
+        }
+    }
+    av_freep(&pool->items);
+    SDL_DestroyMutex(pool->mutex);
+    memset(pool, 0, sizeof(av_pool_t));
+}
+
+// 取一个空白对象，池空时分配新对象，分配失败返回NULL
+void *av_pool_get(av_pool_t *pool) {
+    void *item = NULL;
+
+    SDL_LockMutex(pool->mutex);
+    pool->nb_gets++;
+    if (pool->nb_items > 0) {
+        item = pool->items[--pool->nb_items];
+    } else {
+        pool->nb_allocs++;
+    }
+    SDL_UnlockMutex(pool->mutex);
+
+    if (!item) {
+        item = pool->alloc_item();
+    }
+    return item;
+}
+
+// 归还对象：释放对象引用的数据，对象本身留在池中待复用。item可为NULL
+void av_pool_put(av_pool_t *pool, void *item) {
+    if (!item) {
+        return;
+    }
+    pool->reset_item(item);
+
+    SDL_LockMutex(pool->mutex);
+    if (pool->nb_items < pool->capacity) {
+        pool->items[pool->nb_items++] = item;
+        item = NULL;
+    }
+    SDL_UnlockMutex(pool->mutex);
+
+    if (item) {
+        pool->free_item(item);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef __AV_POOL_H__
+#define __AV_POOL_H__
+
+#include <stdint.h>
+#include <SDL2/SDL_mutex.h>
+
+// AVFrame/AVPacket对象池，多线程共享
+// 流水线中frame和packet在各阶段之间传递，由最后使用它的阶段归还对象池，取用时优先复用池中对象，
+// 只有池空时才真正分配。稳定运行后池中对象足够周转，nb_allocs不再增长，每个packet不再有堆分配
+// 注意：对象池只复用AVFrame/AVPacket结构体本身，数据缓冲区由AVBufferRef管理，解码器内部已有缓冲池
+typedef struct {
+    void **items;                   // 空闲对象
+    int nb_items;
+    int capacity;                   // 最多缓存的空闲对象个数，超出部分直接释放
+    void *(*alloc_item)(void);
+    void (*reset_item)(void *item);
+    void (*free_item)(void *item);
+    int64_t nb_allocs;              // 实际分配对象的次数
+    int64_t nb_gets;                // 取用对象的次数
+    SDL_mutex *mutex;
+}   av_pool_t;
+
+int av_pool_init_frame(av_pool_t *pool, int capacity);
+int av_pool_init_packet(av_pool_t *pool, int capacity);
+void av_pool_destroy(av_pool_t *pool);
+void *av_pool_get(av_pool_t *pool);
+void av_pool_put(av_pool_t *pool, void *item);
+
+#endif
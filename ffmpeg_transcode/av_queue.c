@@ -0,0 +1,129 @@
+#include <string.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "av_queue.h"
+
+int av_queue_init(av_queue_t *q, int capacity) {
+    memset(q, 0, sizeof(av_queue_t));
+    q->items = av_mallocz_array(capacity, sizeof(void *));
+    if (!q->items) {
+        return AVERROR(ENOMEM);
+    }
+    q->capacity = capacity;
+
+    q->mutex = SDL_CreateMutex();
+    q->cond_get = SDL_CreateCond();
+    q->cond_put = SDL_CreateCond();
+    if (!q->mutex || !q->cond_get || !q->cond_put) {
+        av_log(NULL, AV_LOG_ERROR, "Create queue mutex/cond failed: %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+// 释放队列，free_item用于释放队列中残留的元素，可为NULL
+void av_queue_destroy(av_queue_t *q, void (*free_item)(void *item)) {
+    if (q->items && free_item) {
+        while (q->size > 0) {
+            free_item(q->items[q->rindex]);
+            q->rindex = (q->rindex + 1) % q->capacity;
+            q->size--;
+        }
+    }
+    av_freep(&q->items);
+    SDL_DestroyMutex(q->mutex);
+    SDL_DestroyCond(q->cond_get);
+    SDL_DestroyCond(q->cond_put);
+    memset(q, 0, sizeof(av_queue_t));
+}
+
+// 写队列尾部，队列满则等待
+// return 0:                success
+//        AVERROR_EXIT:     queue aborted, item is not queued
+int av_queue_put(av_queue_t *q, void *item) {
+    int ret = 0;
+
+    SDL_LockMutex(q->mutex);
+    while (q->size >= q->capacity && !q->abort_request) {
+        SDL_CondWait(q->cond_put, q->mutex);
+    }
+
+    if (q->abort_request) {
+        ret = AVERROR_EXIT;
+    } else {
+        q->nb_puts++;
+        q->size_sum += q->size;
+        if (q->size > q->max_size) {
+            q->max_size = q->size;
+        }
+        q->items[q->windex] = item;
+        q->windex = (q->windex + 1) % q->capacity;
+        q->size++;
+        SDL_CondSignal(q->cond_get);
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
+
+// 读队列头部
+// return 1:                got an item
+//        0:                queue is empty and block is 0
+//        AVERROR_EOF:      queue is finished and empty
+//        AVERROR_EXIT:     queue aborted
+int av_queue_get(av_queue_t *q, void **item, int block) {
+    int ret;
+
+    SDL_LockMutex(q->mutex);
+    while (1) {
+        if (q->abort_request) {
+            ret = AVERROR_EXIT;
+            break;
+        } else if (q->size > 0) {
+            *item = q->items[q->rindex];
+            q->rindex = (q->rindex + 1) % q->capacity;
+            q->size--;
+            SDL_CondSignal(q->cond_put);
+            ret = 1;
+            break;
+        } else if (q->finished) {
+            ret = AVERROR_EOF;
+            break;
+        } else if (!block) {
+            ret = 0;
+            break;
+        } else {
+            SDL_CondWait(q->cond_get, q->mutex);
+        }
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
+
+// 队列是否已满，队列满时生产者写队列将被阻塞
+int av_queue_full(av_queue_t *q) {
+    SDL_LockMutex(q->mutex);
+    int full = q->size >= q->capacity;
+    SDL_UnlockMutex(q->mutex);
+
+    return full;
+}
+
+// 生产者已写完所有数据，消费者读空队列后将得到AVERROR_EOF
+void av_queue_finish(av_queue_t *q) {
+    SDL_LockMutex(q->mutex);
+    q->finished = 1;
+    SDL_CondBroadcast(q->cond_get);
+    SDL_UnlockMutex(q->mutex);
+}
+
+// 中止队列，唤醒所有阻塞在此队列上的生产者和消费者
+void av_queue_abort(av_queue_t *q) {
+    SDL_LockMutex(q->mutex);
+    q->abort_request = 1;
+    SDL_CondBroadcast(q->cond_get);
+    SDL_CondBroadcast(q->cond_put);
+    SDL_UnlockMutex(q->mutex);
+}
@@ -0,0 +1,36 @@
+#ifndef __AV_QUEUE_H__
+#define __AV_QUEUE_H__
+
+#include <stdint.h>
+#include <SDL2/SDL_mutex.h>
+
+// 有界阻塞队列，用于连接转码流水线中相邻的两个处理阶段(线程)
+// 队列中存放的是指针(AVPacket *或AVFrame *)，队列满时生产者阻塞，队列空时消费者阻塞，
+// 以此实现反压(backpressure)：下游处理慢时，上游自动停下来等待，不会无限占用内存
+typedef struct {
+    void **items;                   // 环形缓冲区
+    int capacity;                   // 队列可存储的最大元素个数
+    int rindex;                     // 读索引
+    int windex;                     // 写索引
+    int size;                       // 队列中元素个数
+    int finished;                   // 生产者已写完所有数据，读空后消费者得到AVERROR_EOF
+    int abort_request;              // 中止标志，置位后所有阻塞的读写操作立即返回AVERROR_EXIT
+    SDL_mutex *mutex;
+    SDL_cond *cond_get;             // 队列非空或状态改变时发信号，唤醒消费者
+    SDL_cond *cond_put;             // 队列非满或状态改变时发信号，唤醒生产者
+
+    // 统计信息：每次写入时的队列深度，用于判断流水线中哪个阶段是瓶颈
+    int64_t nb_puts;                // 写入次数
+    int64_t size_sum;               // 每次写入前队列中元素个数之和，size_sum/nb_puts为平均深度
+    int max_size;                   // 写入前队列中元素个数的最大值
+}   av_queue_t;
+
+int av_queue_init(av_queue_t *q, int capacity);
+void av_queue_destroy(av_queue_t *q, void (*free_item)(void *item));
+int av_queue_put(av_queue_t *q, void *item);
+int av_queue_get(av_queue_t *q, void **item, int block);
+int av_queue_full(av_queue_t *q);
+void av_queue_finish(av_queue_t *q);
+void av_queue_abort(av_queue_t *q);
+
+#endif
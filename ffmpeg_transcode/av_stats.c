@@ -0,0 +1,76 @@
+#include <inttypes.h>
+#include "av_stats.h"
+
+// 耗时us所在的桶
+static int bucket_index(int64_t us) {
+    if (us < 8) {
+        return us < 0 ? 0 : (int)us;
+    }
+
+    int msb = 3;
+    while (msb < 62 && (us >> (msb + 1)) != 0) {
+        msb++;
+    }
+    int idx = (msb - 2) * 8 + (int)((us >> (msb - 3)) & 7);
+    return idx < STAGE_STAT_BUCKETS ? idx : STAGE_STAT_BUCKETS - 1;
+}
+
+// 桶idx中耗时的下限
+static int64_t bucket_lower(int idx) {
+    if (idx < 8) {
+        return idx;
+    }
+
+    int msb = idx / 8 + 2;
+    return (int64_t)(8 + idx % 8) << (msb - 3);
+}
+
+void stage_stat_add(stage_stat_t *stat, int64_t us) {
+    stat->count++;
+    stat->total_us += us;
+    if (us > stat->max_us) {
+        stat->max_us = us;
+    }
+    stat->hist[bucket_index(us)]++;
+}
+
+// 第p百分位的耗时(p取值0~100)，返回所在桶的下限，没有数据时返回0
+int64_t stage_stat_percentile(const stage_stat_t *stat, double p) {
+    if (stat->count == 0) {
+        return 0;
+    }
+
+    int64_t rank = (int64_t)(stat->count * p / 100.0);
+    if (rank >= stat->count) {
+        rank = stat->count - 1;
+    }
+    int64_t seen = 0;
+    for (int i = 0; i < STAGE_STAT_BUCKETS; i++) {
+        seen += stat->hist[i];
+        if (seen > rank) {
+            return bucket_lower(i);
+        }
+    }
+
+    return stat->max_us;
+}
+
+// 以JSON对象形式输出统计结果
+void stage_stat_write_json(FILE *fp, const stage_stat_t *stat) {
+    fprintf(fp, "{\"count\": %"PRId64", \"total_us\": %"PRId64", \"avg_us\": %"PRId64", "
+            "\"p50_us\": %"PRId64", \"p90_us\": %"PRId64", \"p99_us\": %"PRId64", \"max_us\": %"PRId64"}",
+            stat->count, stat->total_us, stat->count > 0 ? stat->total_us / stat->count : 0,
+            stage_stat_percentile(stat, 50), stage_stat_percentile(stat, 90),
+            stage_stat_percentile(stat, 99), stat->max_us);
+}
+
+void stage_stat_merge(stage_stat_t *dst, const stage_stat_t *src) {
+    dst->count += src->count;
+    dst->total_us += src->total_us;
+    if (src->max_us > dst->max_us) {
+        dst->max_us = src->max_us;
+    }
+    for (int i = 0; i < STAGE_STAT_BUCKETS; i++) {
+        dst->hist[i] += src->hist[i];
+    }
+}
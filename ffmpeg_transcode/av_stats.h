@@ -0,0 +1,24 @@
+#ifndef __AV_STATS_H__
+#define __AV_STATS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// 耗时直方图的桶个数：小于8us每微秒一个桶，此后每个2的幂区间再均分为8个桶，相对误差不超过12.5%
+#define STAGE_STAT_BUCKETS  320
+
+// 流水线中一个处理阶段的耗时统计。每个阶段只由一个线程更新，无需加锁
+typedef struct {
+    int64_t count;                  // 调用次数
+    int64_t total_us;               // 总耗时
+    int64_t max_us;                 // 单次最大耗时
+    uint32_t hist[STAGE_STAT_BUCKETS];  // 单次耗时直方图，用于计算百分位数
+}   stage_stat_t;
+
+void stage_stat_add(stage_stat_t *stat, int64_t us);
+int64_t stage_stat_percentile(const stage_stat_t *stat, double p);
+void stage_stat_write_json(FILE *fp, const stage_stat_t *stat);
+// 将src的统计并入dst，用于汇总多路流或多个分块的同一阶段
+void stage_stat_merge(stage_stat_t *dst, const stage_stat_t *src);
+
+#endif
@@ -0,0 +1,233 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL_thread.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include "av_queue.h"
+#include "batch.h"
+#include "job.h"
+
+// 批量转码：一个进程内由固定数量的工作线程依次执行任务列表中的任务
+// 每个任务单独启动一个进程时，进程启动、库初始化和编解码器注册等固定开销与几秒钟短视频的转码时间相当。
+// 这里读取任务的线程与工作线程之间通过有界队列连接，队列满时暂停读取任务列表，任务列表可以是
+// 持续写入的管道。整批任务共用一个核预算，均分给各工作线程，任务自己指定-threads时以任务为准
+
+// 一行任务的最大长度和最大参数个数
+#define MAX_JOB_LINE        4096
+#define MAX_JOB_ARGS        128
+
+typedef struct {
+    int idx;                        // 任务序号，即任务列表中的行号
+    char line[MAX_JOB_LINE];        // 任务行，argv指向其中
+    char *argv[MAX_JOB_ARGS];
+    int argc;
+    transcode_opt_t opt;
+}   batch_job_t;
+
+typedef struct {
+    av_queue_t job_queue;           // reader -> worker, batch_job_t *
+    SDL_Thread *tids[MAX_BATCH_WORKERS];
+    int nb_workers;
+    int job_cores;                  // 每个任务的核预算
+    SDL_mutex *mutex;               // 保护状态行输出和统计
+    int nb_done;
+    int nb_failed;
+}   batch_ctx_t;
+
+// 将任务行就地切分为参数，以空白分隔，双引号括起的参数可含空白。argv[0]为程序名占位
+static int split_args(batch_job_t *job) {
+    char *p = job->line;
+
+    job->argv[0] = "transcode";
+    job->argc = 1;
+    while (1) {
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (job->argc >= MAX_JOB_ARGS) {
+            return AVERROR(E2BIG);
+        }
+        if (*p == '"') {
+            job->argv[job->argc++] = ++p;
+            while (*p != '\0' && *p != '"') {
+                p++;
+            }
+            if (*p != '"') {
+                return AVERROR(EINVAL);
+            }
+        } else {
+            job->argv[job->argc++] = p;
+            while (*p != '\0' && !isspace((unsigned char)*p)) {
+                p++;
+            }
+            if (*p == '\0') {
+                break;
+            }
+        }
+        *p++ = '\0';
+    }
+
+    return 0;
+}
+
+static void print_status(batch_ctx_t *ctx, const batch_job_t *job, int ret, int64_t us) {
+    const char *in_fname = job->opt.in_fname ? job->opt.in_fname : "?";
+    const char *out_fname = job->opt.nb_outputs > 0 ? job->opt.outputs[0].fname : "?";
+
+    SDL_LockMutex(ctx->mutex);
+    ctx->nb_done++;
+    if (ret < 0) {
+        ctx->nb_failed++;
+        printf("[job %d] failed (%s) %.1f ms %s -> %s\n", job->idx, av_err2str(ret), us / 1000.0,
+               in_fname, out_fname);
+    } else {
+        printf("[job %d] ok %.1f ms %s -> %s\n", job->idx, us / 1000.0, in_fname, out_fname);
+    }
+    fflush(stdout);
+    SDL_UnlockMutex(ctx->mutex);
+}
+
+static void free_job_item(void *item) {
+    av_free(item);
+}
+
+// 工作线程：从任务队列中取出任务并执行，直到队列读空
+static int worker_thread(void *arg) {
+    batch_ctx_t *ctx = arg;
+    batch_job_t *job = NULL;
+
+    while (av_queue_get(&ctx->job_queue, (void **)&job, 1) == 1) {
+        int64_t t0 = av_gettime_relative();
+        int ret = job_run(&job->opt, NULL);
+        print_status(ctx, job, ret, av_gettime_relative() - t0);
+        av_free(job);
+    }
+
+    return 0;
+}
+
+// 读取一行任务并解析，空行和以'#'开头的注释行返回1，无效任务打印状态后返回1
+static int read_job(batch_ctx_t *ctx, FILE *fp, int line_no, batch_job_t **pjob) {
+    batch_job_t *job = av_mallocz(sizeof(batch_job_t));
+    char *p;
+    int ret;
+
+    *pjob = NULL;
+    if (!job) {
+        return AVERROR(ENOMEM);
+    }
+    if (!fgets(job->line, sizeof(job->line), fp)) {
+        av_free(job);
+        return ferror(fp) ? AVERROR(EIO) : AVERROR_EOF;
+    }
+    job->idx = line_no;
+    p = job->line + strspn(job->line, " \t\r\n");
+    if (*p == '\0' || *p == '#') {
+        av_free(job);
+        return 1;
+    }
+    if (strchr(job->line, '\n') == NULL && !feof(fp)) {
+        // 行过长：丢弃本行剩余部分
+        int c;
+        while ((c = fgetc(fp)) != EOF && c != '\n') {
+        }
+        ret = AVERROR(E2BIG);
+    } else if ((ret = split_args(job)) == 0) {
+        ret = job_parse_args(job->argc, job->argv, &job->opt);
+    }
+    if (ret < 0) {
+        print_status(ctx, job, ret, 0);
+        av_free(job);
+        return 1;
+    }
+
+    if (job->opt.nb_cores == 0) {
+        job->opt.nb_cores = ctx->job_cores;
+    }
+    *pjob = job;
+    return 0;
+}
+
+int transcode_batch(const char *list_fname, int nb_workers, int nb_cores) {
+    batch_ctx_t ctx;
+    FILE *fp;
+    int line_no = 0;
+    int ret;
+
+    memset(&ctx, 0, sizeof(ctx));
+    if (strcmp(list_fname, "-") == 0) {
+        fp = stdin;
+    } else if (!(fp = fopen(list_fname, "r"))) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Cannot open job list '%s'\n", list_fname);
+        return ret;
+    }
+
+    // 1. 确定并发任务数和每个任务的核预算
+    nb_cores = nb_cores > 0 ? nb_cores : av_cpu_count();
+    ctx.nb_workers = nb_workers > 0 ? nb_workers : av_clip(nb_cores / 2, 1, MAX_BATCH_WORKERS);
+    ctx.job_cores = FFMAX(nb_cores / ctx.nb_workers, 1);
+    av_log(NULL, AV_LOG_INFO, "Batch: %d workers, %d cores per job\n", ctx.nb_workers, ctx.job_cores);
+
+    // 2. 启动工作线程
+    ctx.mutex = SDL_CreateMutex();
+    if (!ctx.mutex) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = av_queue_init(&ctx.job_queue, ctx.nb_workers)) < 0) {
+        goto end;
+    }
+    for (int k = 0; k < ctx.nb_workers; k++) {
+        ctx.tids[k] = SDL_CreateThread(worker_thread, "batch_worker", &ctx);
+        if (!ctx.tids[k]) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+    }
+
+    // 3. 逐行读取任务送入任务队列，队列满时阻塞，直到有工作线程空闲
+    while (ret == 0) {
+        batch_job_t *job = NULL;
+        ret = read_job(&ctx, fp, ++line_no, &job);
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret > 0) {
+            ret = 0;
+            continue;
+        } else if (ret < 0) {
+            break;
+        }
+        if ((ret = av_queue_put(&ctx.job_queue, job)) < 0) {
+            av_free(job);
+        }
+    }
+
+    // 4. 任务列表读完后等待已提交的任务全部完成
+    av_queue_finish(&ctx.job_queue);
+    for (int k = 0; k < ctx.nb_workers; k++) {
+        SDL_WaitThread(ctx.tids[k], NULL);
+    }
+    av_log(NULL, AV_LOG_INFO, "Batch: %d jobs, %d failed\n", ctx.nb_done, ctx.nb_failed);
+    if (ret == 0) {
+        ret = ctx.nb_failed;
+    }
+
+end:
+    av_queue_destroy(&ctx.job_queue, free_job_item);
+    SDL_DestroyMutex(ctx.mutex);
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    return ret;
+}
@@ -0,0 +1,12 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+// 并发任务数上限
+#define MAX_BATCH_WORKERS   64
+
+// 批量转码：从list_fname("-"表示标准输入)逐行读取任务，在一个进程内由nb_workers个工作线程并发执行，
+// 每个任务结束时向标准输出打印一行状态。nb_workers为0时按核数确定，nb_cores为0表示本机全部核
+// 返回失败的任务数，读取任务列表出错时返回负的错误码
+int transcode_batch(const char *list_fname, int nb_workers, int nb_cores);
+
+#endif
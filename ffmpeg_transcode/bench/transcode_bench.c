@@ -0,0 +1,313 @@
+/**
+ * @file
+ * 转码性能基准测试
+ * 输入由lavfi的testsrc2/sine在进程内生成，不依赖外部媒体文件，在任何Linux机器上结果可复现。
+ * 每个用例在独立的子进程中运行完整的转码流水线，父进程统计帧率、CPU时间、峰值内存和输出字节数
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <libavcodec/avcodec.h>
+#include <libavdevice/avdevice.h>
+#include <libavutil/avstring.h>
+#include <libavutil/time.h>
+#include "../chunk.h"
+#include "../transcode.h"
+
+#define MAX_CASES           32
+// 与基线相比帧率下降或峰值内存增长超过此比例视为性能回退
+#define DEFAULT_TOLERANCE   0.10
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    int rate;                       // 帧率
+    int duration;                   // 时长，单位秒
+    const char *v_enc_name;
+    const char *a_enc_name;
+    int nb_outputs;                 // 大于1时输出码率阶梯，依次为原尺寸、1/2、1/4
+    int nb_chunks;
+}   bench_case_t;
+
+typedef struct {
+    char name[64];
+    double fps;                     // 输入帧数/墙上时间
+    double cpu_sec;                 // 用户态+内核态CPU时间
+    long peak_rss_kb;               // 峰值常驻内存
+    int64_t bytes;                  // 所有输出文件的字节数之和
+}   bench_result_t;
+
+static const bench_case_t bench_cases[] = {
+    { "240p_mpeg4_mp2",         320,  240, 25, 10, "mpeg4",   "mp2",  1, 1 },
+    { "720p_mpeg4_mp2",         1280, 720, 25, 10, "mpeg4",   "mp2",  1, 1 },
+    { "1080p_mpeg4_mp2",        1920, 1080, 25, 5, "mpeg4",   "mp2",  1, 1 },
+    { "720p_libx264_aac",       1280, 720, 25, 10, "libx264", "aac",  1, 1 },
+    { "1080p_libx264_aac",      1920, 1080, 25, 5, "libx264", "aac",  1, 1 },
+    { "1080p_mpeg4_chunks4",    1920, 1080, 25, 10, "mpeg4",  "mp2",  1, 4 },
+    { "1080p_mpeg4_ladder3",    1920, 1080, 25, 5, "mpeg4",   "mp2",  3, 1 },
+    { "1080p_copy_copy",        1920, 1080, 25, 10, "copy",   "copy", 1, 1 },
+};
+
+static void show_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-save results.txt] [-baseline baseline.txt] [-tolerance 0.1] [-case name]\n", prog);
+}
+
+// 在子进程中运行转码，父进程等待其结束并取得资源使用情况，各用例的峰值内存互不影响
+// return 0:    success
+//        <0:   fork failed or transcode failed in child
+static int run_in_child(const transcode_opt_t *opt, double *wall_sec, struct rusage *usage) {
+    int64_t start = av_gettime_relative();
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    fflush(stderr);
+    if ((pid = fork()) < 0) {
+        return AVERROR(errno);
+    } else if (pid == 0) {
+        int ret;
+        if (opt->nb_chunks > 1) {
+            ret = transcode_chunked(opt, NULL);
+        } else {
+            ret = transcode(opt, NULL);
+        }
+        _exit(ret < 0 ? 1 : 0);
+    }
+
+    if (wait4(pid, &status, 0, usage) < 0) {
+        return AVERROR(errno);
+    }
+    *wall_sec = (av_gettime_relative() - start) / 1000000.0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return AVERROR_EXTERNAL;
+    }
+
+    return 0;
+}
+
+static int64_t file_size(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? (int64_t)st.st_size : 0;
+}
+
+// 1. 由testsrc2/sine生成源文件(mpeg4+mp2)
+// 2. 以源文件为输入运行被测转码，统计结果
+// 3. 删除临时文件
+static int run_case(const bench_case_t *bc, const char *tmp_dir, bench_result_t *res) {
+    char src_fname[1024], lavfi[512];
+    char out_fnames[MAX_OUTPUTS][1024];
+    transcode_opt_t opt;
+    struct rusage usage;
+    double wall_sec;
+    int ret;
+
+    memset(res, 0, sizeof(*res));
+    av_strlcpy(res->name, bc->name, sizeof(res->name));
+
+    // 1
+    snprintf(src_fname, sizeof(src_fname), "%s/%s_src.mkv", tmp_dir, bc->name);
+    snprintf(lavfi, sizeof(lavfi),
+             "testsrc2=size=%dx%d:rate=%d:duration=%d[out0];"
+             "sine=frequency=1000:sample_rate=48000:duration=%d[out1]",
+             bc->width, bc->height, bc->rate, bc->duration, bc->duration);
+    transcode_opt_init(&opt);
+    opt.in_fname = lavfi;
+    opt.in_fmt_name = "lavfi";
+    opt.v_enc_name = "mpeg4";
+    opt.a_enc_name = "mp2";
+    opt.outputs[0].fname = src_fname;
+    opt.outputs[0].v_bit_rate = (int64_t)bc->width * bc->height * 4;
+    opt.nb_outputs = 1;
+    if ((ret = run_in_child(&opt, &wall_sec, &usage)) < 0) {
+        fprintf(stderr, "%s: generate input failed\n", bc->name);
+        goto end;
+    }
+
+    // 2
+    transcode_opt_init(&opt);
+    opt.in_fname = src_fname;
+    opt.v_enc_name = bc->v_enc_name;
+    opt.a_enc_name = bc->a_enc_name;
+    opt.nb_chunks = bc->nb_chunks;
+    opt.nb_outputs = bc->nb_outputs;
+    for (int i = 0; i < bc->nb_outputs; i++) {
+        snprintf(out_fnames[i], sizeof(out_fnames[i]), "%s/%s_out%d.mkv", tmp_dir, bc->name, i);
+        opt.outputs[i].fname = out_fnames[i];
+        if (bc->nb_outputs > 1) {
+            opt.outputs[i].width = bc->width >> i;
+            opt.outputs[i].height = bc->height >> i;
+        }
+    }
+    if ((ret = run_in_child(&opt, &wall_sec, &usage)) < 0) {
+        fprintf(stderr, "%s: transcode failed\n", bc->name);
+        goto end;
+    }
+
+    res->fps = wall_sec > 0 ? (double)bc->rate * bc->duration / wall_sec : 0;
+    res->cpu_sec = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+                   usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+    res->peak_rss_kb = usage.ru_maxrss;
+    for (int i = 0; i < bc->nb_outputs; i++) {
+        res->bytes += file_size(out_fnames[i]);
+    }
+
+end:
+    // 3
+    unlink(src_fname);
+    for (int i = 0; i < bc->nb_outputs; i++) {
+        snprintf(out_fnames[i], sizeof(out_fnames[i]), "%s/%s_out%d.mkv", tmp_dir, bc->name, i);
+        unlink(out_fnames[i]);
+    }
+
+    return ret;
+}
+
+// 结果文件每行一个用例：name fps cpu_sec peak_rss_kb bytes，#开头的行为注释
+static int save_results(const char *filename, const bench_result_t *results, int nb_results) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return AVERROR(errno);
+    }
+
+    fprintf(fp, "# name fps cpu_sec peak_rss_kb bytes\n");
+    for (int i = 0; i < nb_results; i++) {
+        fprintf(fp, "%s %.2f %.3f %ld %"PRId64"\n", results[i].name, results[i].fps,
+                results[i].cpu_sec, results[i].peak_rss_kb, results[i].bytes);
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+static int load_results(const char *filename, bench_result_t *results, int max_results) {
+    char line[256];
+    int nb_results = 0;
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return AVERROR(errno);
+    }
+
+    while (nb_results < max_results && fgets(line, sizeof(line), fp)) {
+        bench_result_t *r = &results[nb_results];
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%63s %lf %lf %ld %"SCNd64, r->name, &r->fps, &r->cpu_sec,
+                   &r->peak_rss_kb, &r->bytes) == 5) {
+            nb_results++;
+        }
+    }
+    fclose(fp);
+
+    return nb_results;
+}
+
+// 与基线逐项比较，返回发生回退的用例个数。基线中不存在的用例不比较
+static int compare_results(const bench_result_t *results, int nb_results,
+                           const bench_result_t *base, int nb_base, double tolerance) {
+    int nb_regressions = 0;
+
+    for (int i = 0; i < nb_results; i++) {
+        const bench_result_t *r = &results[i];
+        for (int j = 0; j < nb_base; j++) {
+            const bench_result_t *b = &base[j];
+            if (strcmp(r->name, b->name) != 0) {
+                continue;
+            }
+            if (r->fps < b->fps * (1 - tolerance)) {
+                printf("REGRESSION %s: fps %.2f -> %.2f\n", r->name, b->fps, r->fps);
+                nb_regressions++;
+            }
+            if (r->peak_rss_kb > b->peak_rss_kb * (1 + tolerance)) {
+                printf("REGRESSION %s: peak_rss_kb %ld -> %ld\n", r->name, b->peak_rss_kb, r->peak_rss_kb);
+                nb_regressions++;
+            }
+            break;
+        }
+    }
+
+    return nb_regressions;
+}
+
+// ./transcode_bench -save baseline.txt
+// ./transcode_bench -baseline baseline.txt -save current.txt
+int main(int argc, char **argv) {
+    const char *save_fname = NULL, *base_fname = NULL, *case_name = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    bench_result_t results[MAX_CASES], base[MAX_CASES];
+    int nb_results = 0, nb_failed = 0;
+    char tmp_dir[] = "/tmp/transcode_bench_XXXXXX";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-save") == 0 && i + 1 < argc) {
+            save_fname = argv[++i];
+        } else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            base_fname = argv[++i];
+        } else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-case") == 0 && i + 1 < argc) {
+            case_name = argv[++i];
+        } else {
+            show_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    avdevice_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+    if (!mkdtemp(tmp_dir)) {
+        fprintf(stderr, "Could not create temp dir\n");
+        return 1;
+    }
+
+    printf("%-24s %10s %10s %12s %12s\n", "name", "fps", "cpu_sec", "peak_rss_kb", "bytes");
+    for (int i = 0; i < FF_ARRAY_ELEMS(bench_cases); i++) {
+        const bench_case_t *bc = &bench_cases[i];
+        bench_result_t *res = &results[nb_results];
+
+        if (case_name && strcmp(case_name, bc->name) != 0) {
+            continue;
+        }
+        if ((strcmp(bc->v_enc_name, "copy") != 0 && !avcodec_find_encoder_by_name(bc->v_enc_name)) ||
+            (strcmp(bc->a_enc_name, "copy") != 0 && !avcodec_find_encoder_by_name(bc->a_enc_name))) {
+            printf("%-24s SKIP (encoder not available)\n", bc->name);
+            continue;
+        }
+        if (run_case(bc, tmp_dir, res) < 0) {
+            printf("%-24s FAILED\n", bc->name);
+            nb_failed++;
+            continue;
+        }
+        printf("%-24s %10.2f %10.3f %12ld %12"PRId64"\n", res->name, res->fps, res->cpu_sec,
+               res->peak_rss_kb, res->bytes);
+        nb_results++;
+    }
+    rmdir(tmp_dir);
+
+    if (save_fname && save_results(save_fname, results, nb_results) < 0) {
+        return 1;
+    }
+    if (base_fname) {
+        int nb_base = load_results(base_fname, base, MAX_CASES);
+        if (nb_base < 0) {
+            return 1;
+        }
+        if (compare_results(results, nb_results, base, nb_base, tolerance) > 0) {
+            return 2;
+        }
+    }
+
+    return nb_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "checkpoint.h"
+
+// 断点文件是文本格式：
+//   transcode-checkpoint 1
+//   output_pos <字节数>
+//   key <流序号> <pts>
+//   streams <流个数>
+//   <流序号> <dts> <结束时间>   每路流一行，未写出时均为nopts
+#define CHECKPOINT_VERSION  2
+
+int checkpoint_alloc(checkpoint_t *ckpt, int nb_streams) {
+    memset(ckpt, 0, sizeof(checkpoint_t));
+    ckpt->last_dts = av_mallocz_array(nb_streams, sizeof(int64_t));
+    ckpt->end_ts = av_mallocz_array(nb_streams, sizeof(int64_t));
+    if (!ckpt->last_dts || !ckpt->end_ts) {
+        checkpoint_free(ckpt);
+        return AVERROR(ENOMEM);
+    }
+    ckpt->nb_streams = nb_streams;
+    ckpt->key_stream = -1;
+    ckpt->key_pts = AV_NOPTS_VALUE;
+    for (int i = 0; i < nb_streams; i++) {
+        ckpt->last_dts[i] = AV_NOPTS_VALUE;
+        ckpt->end_ts[i] = AV_NOPTS_VALUE;
+    }
+
+    return 0;
+}
+
+void checkpoint_free(checkpoint_t *ckpt) {
+    av_freep(&ckpt->last_dts);
+    av_freep(&ckpt->end_ts);
+    ckpt->nb_streams = 0;
+}
+
+int checkpoint_write(const char *filename, const checkpoint_t *ckpt) {
+    char tmp_name[1024];
+    FILE *fp;
+    int ret = 0;
+
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename);
+    fp = fopen(tmp_name, "w");
+    if (!fp) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Cannot open checkpoint file '%s'\n", tmp_name);
+        return ret;
+    }
+    fprintf(fp, "transcode-checkpoint %d\n", CHECKPOINT_VERSION);
+    fprintf(fp, "output_pos %"PRId64"\n", ckpt->out_pos);
+    fprintf(fp, "key %d %"PRId64"\n", ckpt->key_stream, ckpt->key_pts);
+    fprintf(fp, "streams %d\n", ckpt->nb_streams);
+    for (int i = 0; i < ckpt->nb_streams; i++) {
+        if (ckpt->last_dts[i] == AV_NOPTS_VALUE) {
+            fprintf(fp, "%d nopts nopts\n", i);
+        } else {
+            fprintf(fp, "%d %"PRId64" %"PRId64"\n", i, ckpt->last_dts[i], ckpt->end_ts[i]);
+        }
+    }
+    if (fflush(fp) != 0 || ferror(fp)) {
+        ret = AVERROR(errno);
+    }
+    fclose(fp);
+    if (ret == 0 && rename(tmp_name, filename) != 0) {
+        ret = AVERROR(errno);
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to write checkpoint file '%s': %s\n", filename, av_err2str(ret));
+    }
+
+    return ret;
+}
+
+int checkpoint_read(const char *filename, checkpoint_t *ckpt) {
+    FILE *fp = fopen(filename, "r");
+    char dts[32], end_ts[32];
+    int version = 0, nb_streams = 0, idx;
+    int64_t out_pos, key_pts;
+    int key_stream;
+    int ret;
+
+    memset(ckpt, 0, sizeof(checkpoint_t));
+    if (!fp) {
+        return AVERROR(errno);
+    }
+    if (fscanf(fp, "transcode-checkpoint %d ", &version) != 1 || version != CHECKPOINT_VERSION ||
+        fscanf(fp, "output_pos %"SCNd64" ", &out_pos) != 1 ||
+        fscanf(fp, "key %d %"SCNd64" ", &key_stream, &key_pts) != 2 ||
+        fscanf(fp, "streams %d ", &nb_streams) != 1 || nb_streams <= 0 ||
+        key_stream < 0 || key_stream >= nb_streams || out_pos <= 0) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    if ((ret = checkpoint_alloc(ckpt, nb_streams)) < 0) {
+        goto end;
+    }
+    ckpt->out_pos = out_pos;
+    ckpt->key_stream = key_stream;
+    ckpt->key_pts = key_pts;
+    for (int i = 0; i < nb_streams; i++) {
+        if (fscanf(fp, "%d %31s %31s ", &idx, dts, end_ts) != 3 || idx != i) {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        if ((strcmp(dts, "nopts") != 0 && sscanf(dts, "%"SCNd64, &ckpt->last_dts[i]) != 1) ||
+            (strcmp(end_ts, "nopts") != 0 && sscanf(end_ts, "%"SCNd64, &ckpt->end_ts[i]) != 1)) {
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+    }
+
+end:
+    fclose(fp);
+    if (ret < 0) {
+        checkpoint_free(ckpt);
+        av_log(NULL, AV_LOG_ERROR, "Invalid checkpoint file '%s'\n", filename);
+    }
+    return ret;
+}
@@ -0,0 +1,27 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdint.h>
+
+// 断点续转：长时间转码时定期在输出视频关键帧处记录断点，进程被杀后重新运行同一命令，
+// 从断点处续写输出文件，而不是从头转码
+// 断点处输出文件是完整的：此前的packet已全部写出，此后的packet从一个新的关键帧开始。
+// 续转时截掉输出文件中out_pos之后的数据，将输入定位到断点之前的关键帧，丢弃各流已写出的部分
+typedef struct {
+    int64_t out_pos;                // 输出文件中已完整写出的字节数
+    int key_stream;                 // 断点所在的流
+    int64_t key_pts;                // 断点关键帧的pts，单位是key_stream的输出时基，续转时从此帧开始编码
+    int nb_streams;
+    int64_t *last_dts;              // int64_t last_dts[]，各输出流最后写出的dts，AV_NOPTS_VALUE表示未写出
+    int64_t *end_ts;                // int64_t end_ts[]，各输出流最后写出的packet的结束时间(dts + duration)，
+                                    // 重新编码的音频流续转时从此采样点开始编码
+}   checkpoint_t;
+
+int checkpoint_alloc(checkpoint_t *ckpt, int nb_streams);
+void checkpoint_free(checkpoint_t *ckpt);
+// 先写入临时文件再改名，进程在写断点时被杀也不会留下不完整的断点文件
+int checkpoint_write(const char *filename, const checkpoint_t *ckpt);
+// 断点文件不存在时返回AVERROR(ENOENT)，格式错误时返回AVERROR_INVALIDDATA
+int checkpoint_read(const char *filename, checkpoint_t *ckpt);
+
+#endif
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <string.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include "av_codec.h"
+#include "chunk.h"
+#include "report.h"
+
+// 分块转码：按视频关键帧将输入切分为若干段，各段在独立的线程中并行转码为临时文件，
+// 最后将各段无损拼接为输出文件。每段都从关键帧开始，各段的编码互不依赖
+// 第0段转码全部视频帧之前的部分以及所有非视频流，其余各段只转码各自区间内的视频帧，
+// 因此音频等流只被编码一次，拼接后音视频同步与直接转码完全一致
+
+typedef struct {
+    transcode_opt_t opt;
+    char *fname;                    // 临时文件名
+    SDL_Thread *tid;
+    transcode_stats_t stats;
+    int ret;
+}   chunk_t;
+
+static int chunk_thread(void *arg) {
+    chunk_t *chunk = arg;
+    chunk->ret = transcode(&chunk->opt, &chunk->stats);
+    return chunk->ret;
+}
+
+static int64_t packet_pts(const AVPacket *pkt) {
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+// 从当前位置向后读取，找到stream_idx流中第一个pts不小于min_pts的关键帧
+static int read_key_packet(AVFormatContext *fmt_ctx, int stream_idx, int64_t min_pts, int64_t *pts) {
+    AVPacket pkt;
+    int ret;
+
+    av_init_packet(&pkt);
+    while ((ret = av_read_frame(fmt_ctx, &pkt)) >= 0) {
+        int64_t ts = packet_pts(&pkt);
+        int found = pkt.stream_index == stream_idx && (pkt.flags & AV_PKT_FLAG_KEY) &&
+                    ts != AV_NOPTS_VALUE && ts >= min_pts;
+        av_packet_unref(&pkt);
+        if (found) {
+            *pts = ts;
+            return 0;
+        }
+    }
+
+    return ret;
+}
+
+// 确定分块边界：将视频流时长均分为nb_chunks份，每个等分点之后的第一个关键帧即为一段的起点
+// bounds[k]是第k+1段的起点，单位是视频流时基*tb；*start是第一个关键帧的pts
+// *o_stream_idx是视频流在各段临时文件中的序号，临时文件中只有-map选中的流
+static int find_chunk_bounds(const transcode_opt_t *opt, int *stream_idx, int *o_stream_idx, AVRational *tb,
+                             int64_t *start, int64_t *bounds, int *nb_bounds) {
+    AVFormatContext *fmt_ctx = NULL;
+    int ret;
+
+    *nb_bounds = 0;
+    ret = open_media_file(opt->in_fname, opt->in_fmt_name, opt->in_mmap, &fmt_ctx);
+    if (ret < 0) {
+        goto end;
+    }
+
+    if ((ret = select_streams(fmt_ctx, opt->maps, opt->nb_maps)) < 0) {
+        goto end;
+    }
+    *stream_idx = find_best_mapped_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO);
+    if (*stream_idx < 0) {
+        av_log(NULL, AV_LOG_WARNING, "No video stream, chunked transcoding disabled\n");
+        ret = 0;
+        goto end;
+    }
+    *o_stream_idx = 0;
+    for (int i = 0; i < *stream_idx; i++) {
+        *o_stream_idx += fmt_ctx->streams[i]->discard != AVDISCARD_ALL;
+    }
+
+    AVStream *st = fmt_ctx->streams[*stream_idx];
+    *tb = st->time_base;
+    int64_t duration = st->duration;
+    if (duration == AV_NOPTS_VALUE && fmt_ctx->duration != AV_NOPTS_VALUE) {
+        duration = av_rescale_q(fmt_ctx->duration, AV_TIME_BASE_Q, st->time_base);
+    }
+    if (duration == AV_NOPTS_VALUE || duration <= 0) {
+        av_log(NULL, AV_LOG_WARNING, "Unknown video duration, chunked transcoding disabled\n");
+        ret = 0;
+        goto end;
+    }
+
+    ret = read_key_packet(fmt_ctx, *stream_idx, INT64_MIN, start);
+    if (ret < 0) {
+        goto end;
+    }
+    int64_t st_start = st->start_time != AV_NOPTS_VALUE ? st->start_time : *start;
+    int64_t last = *start;
+
+    for (int k = 1; k < opt->nb_chunks; k++) {
+        int64_t target = st_start + av_rescale(duration, k, opt->nb_chunks);
+        int64_t pts;
+        if (target <= last) {
+            continue;
+        }
+        // 定位到等分点之前的关键帧，再向后读到等分点之后的第一个关键帧
+        ret = avformat_seek_file(fmt_ctx, *stream_idx, INT64_MIN, target, target, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Seek to %"PRId64" failed\n", target);
+            goto end;
+        }
+        ret = read_key_packet(fmt_ctx, *stream_idx, target, &pts);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            goto end;
+        }
+        if (pts > last) {
+            bounds[(*nb_bounds)++] = pts;
+            last = pts;
+        }
+    }
+    ret = 0;
+
+end:
+    avio_mmap_close_input(&fmt_ctx);
+    return ret;
+}
+
+// 临时文件名：output.ts -> output.part00.ts，与输出文件使用相同的封装格式
+static char *chunk_file_name(const char *out_fname, int k) {
+    const char *slash = strrchr(out_fname, '/');
+    const char *dot = strrchr(out_fname, '.');
+    if (!dot || (slash && dot < slash)) {
+        dot = out_fname + strlen(out_fname);
+    }
+    return av_asprintf("%.*s.part%02d%s", (int)(dot - out_fname), out_fname, k, dot);
+}
+
+// 读取媒体文件中stream_idx流第一个packet的pts，读完后重新打开文件，使读位置回到文件开头
+static int probe_first_pts(const char *filename, bool use_mmap, AVFormatContext **fmt_ctx, int stream_idx,
+                           int64_t *pts) {
+    AVPacket pkt;
+    int ret;
+
+    if ((ret = open_media_file(filename, NULL, use_mmap, fmt_ctx)) < 0) {
+        return ret;
+    }
+    av_init_packet(&pkt);
+    *pts = AV_NOPTS_VALUE;
+    while (*pts == AV_NOPTS_VALUE && (ret = av_read_frame(*fmt_ctx, &pkt)) >= 0) {
+        if (pkt.stream_index == stream_idx) {
+            *pts = packet_pts(&pkt);
+        }
+        av_packet_unref(&pkt);
+    }
+    avio_mmap_close_input(fmt_ctx);
+    if (*pts == AV_NOPTS_VALUE) {
+        av_log(NULL, AV_LOG_ERROR, "No video packet in %s\n", filename);
+        return ret < 0 ? ret : AVERROR_INVALIDDATA;
+    }
+
+    return open_media_file(filename, NULL, use_mmap, fmt_ctx);
+}
+
+// 拼接时的读取状态：reader A读第0段的所有流，reader B依次读第1..N-1段的视频流
+typedef struct {
+    AVFormatContext *fmt_ctx;
+    AVPacket *pkt;                  // 已读出、尚未写出的packet
+    int64_t offset;                 // 本段视频时间戳的修正量，单位是本段视频流时基
+    int eof;
+}   chunk_reader_t;
+
+static int reader_fill(chunk_reader_t *rd, int video_only, int stream_idx) {
+    int ret;
+
+    while (!rd->pkt && !rd->eof) {
+        AVPacket *pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+        ret = av_read_frame(rd->fmt_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            av_packet_free(&pkt);
+            rd->eof = 1;
+            break;
+        } else if (ret < 0) {
+            av_packet_free(&pkt);
+            return ret;
+        }
+        if (video_only && pkt->stream_index != stream_idx) {
+            av_packet_free(&pkt);
+            continue;
+        }
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts += rd->offset;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts += rd->offset;
+        }
+        rd->pkt = pkt;
+    }
+
+    return 0;
+}
+
+// 打开第k段用于读取视频流，计算时间戳修正量：
+// 使本段第一个视频packet相对第0段第一个视频packet的时间差，等于两段起始关键帧在输入文件中的时间差。
+// 这样各段封装时各自引入的时间戳偏移(如避免负dts)都被抵消
+static int reader_open_chunk(chunk_reader_t *rd, const chunk_t *chunk, int stream_idx,
+                             AVRational in_tb, int64_t in_start, int64_t base_pts, AVRational base_tb) {
+    int64_t first_pts;
+    int ret;
+
+    ret = probe_first_pts(chunk->fname, chunk->opt.in_mmap, &rd->fmt_ctx, stream_idx, &first_pts);
+    if (ret < 0) {
+        return ret;
+    }
+    AVRational tb = rd->fmt_ctx->streams[stream_idx]->time_base;
+    rd->offset = av_rescale_q(chunk->opt.chunk_start - in_start, in_tb, tb) -
+                 (first_pts - av_rescale_q(base_pts, base_tb, tb));
+    rd->eof = 0;
+
+    return 0;
+}
+
+static void reader_close(chunk_reader_t *rd) {
+    av_packet_free(&rd->pkt);
+    avio_mmap_close_input(&rd->fmt_ctx);
+}
+
+// 拼接：以第0段为基础创建输出文件，按dts顺序交织第0段的所有流和后续各段的视频流
+// stream_idx是视频流在临时文件中的序号
+static int concat_chunks(const transcode_opt_t *opt, chunk_t *chunks, int nb_chunks,
+                         int stream_idx, AVRational in_tb, int64_t in_start) {
+    AVFormatContext *ofmt_ctx = NULL;
+    chunk_reader_t ra = { 0 }, rb = { 0 };
+    int64_t *last_dts = NULL;
+    int64_t base_pts;
+    int next = 1;
+    int ret;
+
+    ret = probe_first_pts(chunks[0].fname, opt->in_mmap, &ra.fmt_ctx, stream_idx, &base_pts);
+    if (ret < 0) {
+        goto end;
+    }
+    AVRational base_tb = ra.fmt_ctx->streams[stream_idx]->time_base;
+
+    avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, opt->outputs[0].fname);
+    if (!ofmt_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not create output context\n");
+        ret = AVERROR_UNKNOWN;
+        goto end;
+    }
+    for (unsigned int i = 0; i < ra.fmt_ctx->nb_streams; i++) {
+        AVStream *in_stream = ra.fmt_ctx->streams[i];
+        AVStream *out_stream = avformat_new_stream(ofmt_ctx, NULL);
+        if (!out_stream) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+        if (ret < 0) {
+            goto end;
+        }
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = in_stream->time_base;
+    }
+    last_dts = av_mallocz_array(ofmt_ctx->nb_streams, sizeof(int64_t));
+    if (!last_dts) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (unsigned int i = 0; i < ofmt_ctx->nb_streams; i++) {
+        last_dts[i] = AV_NOPTS_VALUE;
+    }
+
+    if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&ofmt_ctx->pb, opt->outputs[0].fname, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'", opt->outputs[0].fname);
+            goto end;
+        }
+    }
+    ret = avformat_write_header(ofmt_ctx, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error occurred when opening output file\n");
+        goto end;
+    }
+
+    rb.eof = 1;
+    while (1) {
+        if ((ret = reader_fill(&ra, 0, stream_idx)) < 0) {
+            goto end;
+        }
+        // reader B读完一段后接着读下一段
+        while (!rb.pkt) {
+            if ((ret = reader_fill(&rb, 1, stream_idx)) < 0) {
+                goto end;
+            }
+            if (rb.pkt || next >= nb_chunks) {
+                break;
+            }
+            reader_close(&rb);
+            ret = reader_open_chunk(&rb, &chunks[next++], stream_idx, in_tb, in_start, base_pts, base_tb);
+            if (ret < 0) {
+                goto end;
+            }
+        }
+        if (!ra.pkt && !rb.pkt) {
+            break;
+        }
+
+        chunk_reader_t *rd = &ra;
+        if (!ra.pkt || (rb.pkt && ra.pkt->dts != AV_NOPTS_VALUE && rb.pkt->dts != AV_NOPTS_VALUE &&
+                        av_compare_ts(rb.pkt->dts, rb.fmt_ctx->streams[stream_idx]->time_base,
+                                      ra.pkt->dts, ra.fmt_ctx->streams[ra.pkt->stream_index]->time_base) < 0)) {
+            rd = &rb;
+        }
+
+        AVPacket *pkt = rd->pkt;
+        rd->pkt = NULL;
+        int idx = pkt->stream_index;
+        av_packet_rescale_ts(pkt, rd->fmt_ctx->streams[idx]->time_base, ofmt_ctx->streams[idx]->time_base);
+        pkt->pos = -1;
+        // 各段由独立的编码器输出，有B帧时下一段起始的dts(小于其pts)可能不大于上一段末尾的dts
+        av_packet_fix_seam_dts(pkt, &last_dts[idx]);
+        ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+        av_packet_free(&pkt);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "write frame error %d\n", ret);
+            goto end;
+        }
+    }
+
+    ret = av_write_trailer(ofmt_ctx);
+
+end:
+    reader_close(&ra);
+    reader_close(&rb);
+    av_free(last_dts);
+    if (ofmt_ctx && !(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&ofmt_ctx->pb);
+    }
+    avformat_free_context(ofmt_ctx);
+
+    return ret;
+}
+
+int transcode_chunked(const transcode_opt_t *opt, transcode_stats_t *stats) {
+    chunk_t *chunks = NULL;         // 每段含各阶段的耗时直方图，占用较大，不放在栈上
+    int64_t bounds[MAX_CHUNKS];
+    int64_t in_start = 0;
+    int nb_bounds = 0;
+    int nb_chunks = 0;
+    int stream_idx = -1;            // 视频流在输入文件中的序号
+    int o_stream_idx = -1;          // 视频流在各段临时文件中的序号
+    AVRational in_tb = { 0, 1 };
+    int64_t start_time = av_gettime_relative();
+    int ret;
+
+    // 1. 确定分块边界
+    if (opt->nb_chunks > 1 && opt->nb_outputs == 1 && strcmp(opt->v_enc_name, "copy") != 0) {
+        transcode_opt_t probe_opt = *opt;
+        probe_opt.nb_chunks = FFMIN(opt->nb_chunks, MAX_CHUNKS);
+        ret = find_chunk_bounds(&probe_opt, &stream_idx, &o_stream_idx, &in_tb, &in_start, bounds, &nb_bounds);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (nb_bounds == 0) {
+        // 没有视频流、无法切分、有多个输出文件或视频直接复制，退化为普通转码
+        return transcode(opt, stats);
+    }
+
+    // 2. 各段在独立的线程中并行转码
+    chunks = av_mallocz_array(nb_bounds + 1, sizeof(chunk_t));
+    if (!chunks) {
+        return AVERROR(ENOMEM);
+    }
+    nb_chunks = nb_bounds + 1;
+    av_log(NULL, AV_LOG_INFO, "Transcoding in %d chunks\n", nb_chunks);
+    for (int k = 0; k < nb_chunks; k++) {
+        chunk_t *chunk = &chunks[k];
+        chunk->opt = *opt;
+        chunk->opt.nb_chunks = 1;
+        // 各段并行运行，平分本任务的核预算
+        chunk->opt.nb_cores = FFMAX((opt->nb_cores > 0 ? opt->nb_cores : av_cpu_count()) / nb_chunks, 1);
+        chunk->opt.report_fname = NULL;     // 各段的统计由transcode()填入stats，拼接后汇总为一份报告
+        chunk->opt.chunk_stream = stream_idx;
+        chunk->opt.chunk_start = k > 0 ? bounds[k - 1] : AV_NOPTS_VALUE;
+        chunk->opt.chunk_end = k < nb_bounds ? bounds[k] : AV_NOPTS_VALUE;
+        chunk->opt.chunk_only = k > 0;
+        chunk->fname = chunk_file_name(opt->outputs[0].fname, k);
+        if (!chunk->fname) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        chunk->opt.outputs[0].fname = chunk->fname;
+    }
+    for (int k = 0; k < nb_chunks; k++) {
+        chunks[k].tid = SDL_CreateThread(chunk_thread, "chunk", &chunks[k]);
+        if (!chunks[k].tid) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+            chunks[k].ret = AVERROR(ENOMEM);
+        }
+    }
+    ret = 0;
+    for (int k = 0; k < nb_chunks; k++) {
+        SDL_WaitThread(chunks[k].tid, NULL);
+        if (chunks[k].ret < 0 && ret == 0) {
+            ret = chunks[k].ret;
+        }
+        if (stats) {
+            stats->nb_packet_allocs += chunks[k].stats.nb_packet_allocs;
+            stats->nb_packet_gets += chunks[k].stats.nb_packet_gets;
+            stats->nb_frame_allocs += chunks[k].stats.nb_frame_allocs;
+            stats->nb_frame_gets += chunks[k].stats.nb_frame_gets;
+        }
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Chunk transcoding failed: %s\n", av_err2str(ret));
+        goto end;
+    }
+
+    // 3. 拼接各段，删除临时文件
+    int64_t concat_start = av_gettime_relative();
+    ret = concat_chunks(opt, chunks, nb_chunks, o_stream_idx, in_tb, in_start);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Concatenating chunks failed: %s\n", av_err2str(ret));
+        goto end;
+    }
+
+    // 4. 汇总各段的统计写入运行报告
+    if (opt->report_fname) {
+        const transcode_stats_t *chunk_stats[MAX_CHUNKS];
+        int64_t now = av_gettime_relative();
+        for (int k = 0; k < nb_chunks; k++) {
+            chunk_stats[k] = &chunks[k].stats;
+        }
+        ret = write_chunk_report(opt, chunk_stats, nb_chunks, now - start_time, now - concat_start,
+                                 opt->report_fname);
+    }
+
+end:
+    for (int k = 0; k < nb_chunks; k++) {
+        if (chunks[k].fname) {
+            if (ret >= 0) {
+                remove(chunks[k].fname);
+            }
+            av_free(chunks[k].fname);
+        }
+    }
+    av_free(chunks);
+
+    return ret;
+}
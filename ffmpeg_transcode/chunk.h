@@ -0,0 +1,12 @@
+#ifndef __CHUNK_H__
+#define __CHUNK_H__
+
+#include "transcode.h"
+
+// 分块转码的最大分块数
+#define MAX_CHUNKS          64
+
+// stats可为NULL，各段的统计信息累加到stats中
+int transcode_chunked(const transcode_opt_t *opt, transcode_stats_t *stats);
+
+#endif
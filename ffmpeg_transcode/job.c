@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/error.h>
+#include <libavutil/eval.h>
+#include <libavutil/log.h>
+#include <libavutil/parseutils.h>
+#include "chunk.h"
+#include "job.h"
+#include "smart_trim.h"
+#include "thumbnail.h"
+
+int job_parse_args(int argc, char **argv, transcode_opt_t *opt) {
+    output_opt_t oopt = { 0 };
+    int64_t duration = AV_NOPTS_VALUE;
+
+    transcode_opt_init(opt);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            opt->in_fmt_name = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            opt->in_fname = argv[++i];
+        } else if (strcmp(argv[i], "-map") == 0 && i + 1 < argc) {
+            if (opt->nb_maps >= MAX_MAPS) {
+                return AVERROR(EINVAL);
+            }
+            opt->maps[opt->nb_maps++] = argv[++i];
+        } else if (strcmp(argv[i], "-mmap") == 0) {
+            opt->in_mmap = true;
+        } else if (strcmp(argv[i], "-c:v") == 0 && i + 1 < argc) {
+            opt->v_enc_name = argv[++i];
+        } else if (strcmp(argv[i], "-c:a") == 0 && i + 1 < argc) {
+            opt->a_enc_name = argv[++i];
+        } else if (strcmp(argv[i], "-vf") == 0 && i + 1 < argc) {
+            opt->v_filters = argv[++i];
+        } else if (strcmp(argv[i], "-af") == 0 && i + 1 < argc) {
+            opt->a_filters = argv[++i];
+        } else if (strcmp(argv[i], "-bsf:v") == 0 && i + 1 < argc) {
+            opt->v_bsf_name = argv[++i];
+        } else if (strcmp(argv[i], "-bsf:a") == 0 && i + 1 < argc) {
+            opt->a_bsf_name = argv[++i];
+        } else if (strcmp(argv[i], "-report") == 0 && i + 1 < argc) {
+            opt->report_fname = argv[++i];
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            opt->nb_cores = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-chunks") == 0 && i + 1 < argc) {
+            opt->nb_chunks = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "-ss") == 0 || strcmp(argv[i], "-to") == 0) && i + 1 < argc) {
+            int64_t *ts = argv[i][1] == 's' ? &opt->trim_start : &opt->trim_end;
+            if (av_parse_time(ts, argv[++i], 1) < 0) {
+                return AVERROR(EINVAL);
+            }
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (av_parse_time(&duration, argv[++i], 1) < 0 || duration <= 0) {
+                return AVERROR(EINVAL);
+            }
+        } else if (strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc) {
+            opt->checkpoint_fname = argv[++i];
+        } else if (strcmp(argv[i], "-checkpoint_interval") == 0 && i + 1 < argc) {
+            opt->checkpoint_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-thumbs") == 0 && i + 1 < argc) {
+            opt->nb_thumbs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-tile") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &opt->thumb_cols, &opt->thumb_rows) < 1) {
+                return AVERROR(EINVAL);
+            }
+        } else if (strcmp(argv[i], "-dedup") == 0) {
+            opt->dedup = true;
+        } else if (strcmp(argv[i], "-smart") == 0) {
+            opt->smart_render = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (av_parse_video_size(&oopt.width, &oopt.height, argv[++i]) < 0) {
+                return AVERROR(EINVAL);
+            }
+        } else if (strcmp(argv[i], "-b:v") == 0 && i + 1 < argc) {
+            double rate = 0;
+            if (av_expr_parse_and_eval(&rate, argv[++i], NULL, NULL, NULL, NULL, NULL, NULL,
+                                       NULL, 0, NULL) < 0) {
+                return AVERROR(EINVAL);
+            }
+            oopt.v_bit_rate = (int64_t)rate;
+        } else if (argv[i][0] != '-' && opt->nb_outputs < MAX_OUTPUTS) {
+            oopt.fname = argv[i];
+            opt->outputs[opt->nb_outputs++] = oopt;
+            memset(&oopt, 0, sizeof(oopt));
+        } else {
+            return AVERROR(EINVAL);
+        }
+    }
+    // -s、-b:v作用于其后的输出文件，最后一个输出文件之后的设置无处可用
+    if (oopt.width > 0 || oopt.v_bit_rate > 0) {
+        av_log(NULL, AV_LOG_ERROR, "-s/-b:v given after the last output file\n");
+        return AVERROR(EINVAL);
+    }
+    // 运行报告统计转码流水线各阶段的耗时，智能裁剪和缩略图不经过转码流水线
+    if (opt->report_fname && (opt->smart_render || opt->nb_thumbs > 0)) {
+        av_log(NULL, AV_LOG_ERROR, "-report cannot be used with -smart or -thumbs\n");
+        return AVERROR(EINVAL);
+    }
+    // 智能裁剪按输入的编码参数重新编码，不支持改变尺寸和码率
+    for (int k = 0; opt->smart_render && k < opt->nb_outputs; k++) {
+        if (opt->outputs[k].width > 0 || opt->outputs[k].v_bit_rate > 0) {
+            av_log(NULL, AV_LOG_ERROR, "-s/-b:v cannot be used with -smart\n");
+            return AVERROR(EINVAL);
+        }
+    }
+    // 同时指定-t和-to时以-t为准
+    if (duration != AV_NOPTS_VALUE) {
+        opt->trim_end = (opt->trim_start != AV_NOPTS_VALUE ? opt->trim_start : 0) + duration;
+    }
+    // 智能裁剪只复制和按原格式重新编码，缩略图只解码，都不需要-c:v、-c:a
+    // 普通转码的-ss、-to按输入定位实现，不能与分块转码、断点续转同时使用
+    bool trimmed = opt->trim_start != AV_NOPTS_VALUE || opt->trim_end != AV_NOPTS_VALUE;
+    bool thumbs = opt->nb_thumbs > 0;
+    if (!opt->in_fname || opt->nb_outputs == 0 || opt->nb_chunks < 1 || opt->nb_chunks > MAX_CHUNKS ||
+        opt->nb_cores < 0 || (opt->nb_chunks > 1 && opt->nb_outputs > 1) || opt->checkpoint_interval <= 0 ||
+        (opt->checkpoint_fname && (opt->nb_outputs > 1 || opt->nb_chunks > 1 || opt->smart_render)) ||
+        (!opt->smart_render && !thumbs && (!opt->v_enc_name || !opt->a_enc_name)) ||
+        (trimmed && (opt->nb_chunks > 1 || opt->checkpoint_fname)) ||
+        (thumbs && (opt->nb_outputs > 1 || opt->nb_chunks > 1 || opt->smart_render || opt->checkpoint_fname)) ||
+        opt->nb_thumbs < 0 || opt->thumb_cols < 0 || opt->thumb_rows < 0 ||
+        (opt->smart_render && (opt->nb_outputs > 1 || opt->nb_chunks > 1 || opt->nb_maps > 0)) ||
+        (opt->trim_start != AV_NOPTS_VALUE && opt->trim_end != AV_NOPTS_VALUE && opt->trim_end <= opt->trim_start)) {
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+int job_run(const transcode_opt_t *opt, transcode_stats_t *stats) {
+    if (opt->nb_thumbs > 0) {
+        return transcode_thumbnails(opt);
+    } else if (opt->smart_render) {
+        return transcode_smart_trim(opt);
+    } else if (opt->nb_chunks > 1) {
+        return transcode_chunked(opt, stats);
+    }
+    return transcode(opt, stats);
+}
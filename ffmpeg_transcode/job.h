@@ -0,0 +1,12 @@
+#ifndef __JOB_H__
+#define __JOB_H__
+
+#include "transcode.h"
+
+// 一个转码任务的命令行参数，如"-i input.mp4 -c:v libx264 -c:a aac output.ts"，argv[0]是程序名，不解析
+// opt中的字符串指向argv，使用opt期间argv须保持有效。参数无效时返回AVERROR(EINVAL)
+int job_parse_args(int argc, char **argv, transcode_opt_t *opt);
+// 按opt选择缩略图、智能裁剪、分块转码或普通转码。stats可为NULL
+int job_run(const transcode_opt_t *opt, transcode_stats_t *stats);
+
+#endif
@@ -1,12 +1,86 @@
+#include <string.h>
 #include "open_file.h"
 
-int open_input_file(const char *filename, inout_ctx_t *ictx) {
+int select_streams(AVFormatContext *fmt_ctx, const char *const *maps, int nb_maps) {
+    int nb_selected = 0;
+
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        AVStream *st = fmt_ctx->streams[i];
+        bool selected = nb_maps == 0;
+        for (int k = 0; k < nb_maps && !selected; k++) {
+            int ret = avformat_match_stream_specifier(fmt_ctx, st, maps[k]);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Invalid stream specifier '%s'\n", maps[k]);
+                return ret;
+            }
+            selected = ret > 0;
+        }
+        st->discard = selected ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        nb_selected += selected;
+    }
+    if (nb_selected == 0) {
+        av_log(NULL, AV_LOG_ERROR, "No stream matches the stream maps\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+
+    return nb_selected;
+}
+
+int find_best_mapped_stream(AVFormatContext *fmt_ctx, enum AVMediaType type) {
+    int idx = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
+
+    if (idx >= 0 && fmt_ctx->streams[idx]->discard == AVDISCARD_ALL) {
+        // 最佳流未被选中时取选中的流中第一路该类型的流
+        idx = AVERROR_STREAM_NOT_FOUND;
+        for (unsigned int i = 0; i < fmt_ctx->nb_streams && idx < 0; i++) {
+            AVStream *st = fmt_ctx->streams[i];
+            if (st->codecpar->codec_type == type && st->discard != AVDISCARD_ALL) {
+                idx = i;
+            }
+        }
+    }
+
+    return idx;
+}
+
+// 只打开输入文件并读取流信息，不打开解码器。fmt_name指定封装格式，为NULL时自动探测
+int open_media_file(const char *filename, const char *fmt_name, bool use_mmap, AVFormatContext **fmt_ctx) {
+    AVInputFormat *ifmt = NULL;
+    int ret;
+
+    if (fmt_name && !(ifmt = av_find_input_format(fmt_name))) {
+        av_log(NULL, AV_LOG_ERROR, "Unknown input format %s\n", fmt_name);
+        return AVERROR(EINVAL);
+    }
+    if ((ret = avio_mmap_open_input(fmt_ctx, filename, ifmt, NULL, use_mmap)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open file %s\n", filename);
+        return ret;
+    }
+    if ((ret = avformat_find_stream_info(*fmt_ctx, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot find stream information of %s\n", filename);
+        return ret;
+    }
+
+    return 0;
+}
+
+// fmt_name指定输入封装格式(如"lavfi")，为NULL时根据文件内容探测
+// use_mmap为true时本地文件通过内存映射读取，见avio_mmap.h
+// v_copy/a_copy为true时，视频/音频流直接复制，不打开其解码器
+int open_input_file(const char *filename, const char *fmt_name, bool use_mmap, const char *const *maps, int nb_maps,
+                    bool v_copy, bool a_copy, int v_threads, int a_threads, inout_ctx_t *ictx) {
+    AVInputFormat *ifmt = NULL;
     int ret;
     unsigned int i;
 
+    if (fmt_name && !(ifmt = av_find_input_format(fmt_name))) {
+        av_log(NULL, AV_LOG_ERROR, "Unknown input format %s\n", fmt_name);
+        return AVERROR(EINVAL);
+    }
+
     AVFormatContext *ifmt_ctx = NULL;
     // 1. 打开视频文件：读取文件头，将文件格式信息存储在ifmt_ctx中
-    if ((ret = avformat_open_input(&ifmt_ctx, filename, NULL, NULL)) < 0) {
+    if ((ret = avio_mmap_open_input(&ifmt_ctx, filename, ifmt, NULL, use_mmap)) < 0) {
         av_log(NULL, AV_LOG_ERROR, "Cannot open input file\n");
         return ret;
     }
@@ -18,30 +92,35 @@ int open_input_file(const char *filename, inout_ctx_t *ictx) {
         av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
         return ret;
     }
+    if ((ret = select_streams(ifmt_ctx, maps, nb_maps)) < 0) {
+        return ret;
+    }
 
     // 每路音频流/视频流一个AVCodecContext
     AVCodecContext **pp_dec_ctx = av_mallocz_array(ifmt_ctx->nb_streams, sizeof(AVCodecContext *));
     if (!pp_dec_ctx) {
         return AVERROR(ENOMEM);
     }
+    // 出错返回时已分配的AVCodecContext由调用者随ictx释放
+    ictx->codec_ctx = pp_dec_ctx;
 
-    // 3. 将输入文件中各流对应的AVCodecContext存入数组
+    // 3. 将输入文件中各流对应的AVCodecContext存入数组，未选中的流没有AVCodecContext
+    //    直接复制的流只用AVCodecContext保存流参数，不查找也不打开解码器，本程序没有对应解码器的格式也能直接复制
     for (i = 0; i < ifmt_ctx->nb_streams; i++) {
-        // 3.1 获取解码器AVCodec
         AVStream *stream = ifmt_ctx->streams[i];
-        AVCodec *dec = avcodec_find_decoder(stream->codecpar->codec_id);
+        AVCodec *dec;
         AVCodecContext *codec_ctx;
-        if (!dec) {
-            av_log(NULL, AV_LOG_ERROR, "Failed to find decoder for stream #%u\n", i);
-            return AVERROR_DECODER_NOT_FOUND;
+        if (stream->discard == AVDISCARD_ALL) {
+            continue;
         }
-        // 3.2 AVCodecContext初始化：分配结构体，使用AVCodec初始化AVCodecContext相应成员为默认值
-        codec_ctx = avcodec_alloc_context3(dec);
+        // 3.1 AVCodecContext初始化：分配结构体，不指定AVCodec
+        codec_ctx = avcodec_alloc_context3(NULL);
         if (!codec_ctx) {
             av_log(NULL, AV_LOG_ERROR, "Failed to allocate the decoder context for stream #%u\n", i);
             return AVERROR(ENOMEM);
         }
-        // 3.3 AVCodecContext初始化：使用codec参数codecpar初始化AVCodecContext相应成员
+        pp_dec_ctx[i] = codec_ctx;
+        // 3.2 AVCodecContext初始化：使用codec参数codecpar初始化AVCodecContext相应成员
         ret = avcodec_parameters_to_context(codec_ctx, stream->codecpar);
         if (ret < 0) {
             av_log(NULL, AV_LOG_ERROR, "Failed to copy decoder parameters to input decoder context "
@@ -50,18 +129,26 @@ int open_input_file(const char *filename, inout_ctx_t *ictx) {
         }
         /* Reencode video & audio and remux subtitles etc. */
         // 音频流视频流需要重新编码，字幕流只需要重新封装
-        if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO || codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if ((codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO && !v_copy) ||
+            (codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && !a_copy)) {
+            // 3.3 获取解码器AVCodec
+            dec = avcodec_find_decoder(stream->codecpar->codec_id);
+            if (!dec) {
+                av_log(NULL, AV_LOG_ERROR, "Failed to find decoder for stream #%u\n", i);
+                return AVERROR_DECODER_NOT_FOUND;
+            }
             if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
                 codec_ctx->framerate = av_guess_frame_rate(ifmt_ctx, stream, NULL);
+            // 解码线程数需在打开解码器之前设置
+            codec_ctx->thread_count = (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) ? v_threads : a_threads;
             /* Open decoder */
-            // 3.4 AVCodecContext初始化：使用codec参数codecpar初始化AVCodecContext，初始化完成
+            // 3.4 AVCodecContext初始化：使用AVCodec初始化AVCodecContext，初始化完成
             ret = avcodec_open2(codec_ctx, dec, NULL);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR, "Failed to open decoder for stream #%u\n", i);
                 return ret;
             }
         }
-        pp_dec_ctx[i] = codec_ctx;
     }
 
     av_dump_format(ifmt_ctx, 0, filename, 0);
@@ -72,9 +159,10 @@ int open_input_file(const char *filename, inout_ctx_t *ictx) {
     return 0;
 }
 
-int open_output_file(const char *filename, const inout_ctx_t *ictx, 
-                     const char *v_enc_name, const char *a_enc_name,
-                     inout_ctx_t *octx, AVAudioFifo*** afifo) {
+int open_output_file(const output_opt_t *oopt, const inout_ctx_t *ictx, 
+                     const char *v_enc_name, const char *a_enc_name, int v_threads, int a_threads,
+                     inout_ctx_t *octx, av_audio_ring_t*** afifo) {
+    const char *filename = oopt->fname;
     AVStream *out_stream;
     AVStream *in_stream;
     AVCodecContext *dec_ctx, *enc_ctx;
@@ -90,19 +178,22 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
         return AVERROR_UNKNOWN;
     }
 
-    // 每路音频流/视频流一个AVCodecContext
-    AVCodecContext **pp_enc_ctx = av_mallocz_array(ofmt_ctx->nb_streams, sizeof(AVCodecContext *));
+    // 每路音频流/视频流一个AVCodecContext，输出流与选中的输入流一一对应
+    AVFormatContext *ifmt_ctx = ictx->fmt_ctx;
+    AVCodecContext **pp_enc_ctx = av_mallocz_array(ifmt_ctx->nb_streams, sizeof(AVCodecContext *));
     if (!pp_enc_ctx) {
         return AVERROR(ENOMEM);
     }
 
-    AVAudioFifo **pp_audio_fifo = av_mallocz_array(ofmt_ctx->nb_streams, sizeof(AVAudioFifo *));
-    if (!pp_enc_ctx) {
+    av_audio_ring_t **pp_audio_fifo = av_mallocz_array(ifmt_ctx->nb_streams, sizeof(av_audio_ring_t *));
+    if (!pp_audio_fifo) {
         return AVERROR(ENOMEM);
     }
 
-    AVFormatContext *ifmt_ctx = ictx->fmt_ctx;
     for (i = 0; i < ifmt_ctx->nb_streams; i++) {
+        if (!ictx->codec_ctx[i]) {  // 未选中的输入流
+            continue;
+        }
         // 2. 将一个新流(out_stream)添加到输出文件(ofmt_ctx)
         AVStream *out_stream = NULL;
         out_stream = avformat_new_stream(ofmt_ctx, NULL);
@@ -114,16 +205,18 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
         AVStream *in_stream = ifmt_ctx->streams[i];
         AVCodecContext *dec_ctx = ictx->codec_ctx[i];
 
+        // 编码器名为"copy"的音视频流与字幕等流一样直接复制，不经过解码和编码
+        bool copy = (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO && strcmp(v_enc_name, "copy") == 0) ||
+                    (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && strcmp(a_enc_name, "copy") == 0);
+
         // 3. 构建AVCodecContext
-        if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO || dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {         // 音频流或视频流
-            // 3.1 查找编码器AVCodec，本例使用与解码器相同的编码器
+        if ((dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO || dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) && !copy) { // 音频流或视频流
+            // 3.1 按名称查找编码器AVCodec
             AVCodec *encoder = NULL;
-            if ((dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) && (strcmp(v_enc_name, "copy") != 0)) {
+            if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
                 encoder = avcodec_find_encoder_by_name(v_enc_name);
-            } else if ((dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) && (strcmp(a_enc_name, "copy") != 0)) {
-                encoder = avcodec_find_encoder_by_name(a_enc_name);
             } else {
-                encoder = avcodec_find_encoder(dec_ctx->codec_id);
+                encoder = avcodec_find_encoder_by_name(a_enc_name);
             }
 
             if (!encoder) {
@@ -142,8 +235,9 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
              * sample rate etc.). These properties can be changed for output
              * streams easily using filters */
             if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-                enc_ctx->height = dec_ctx->height;              // 图像高
-                enc_ctx->width = dec_ctx->width;                // 图像宽
+                // -s指定的尺寸由滤镜图末尾的scale滤镜缩放得到；未指定-s时为解码尺寸，有-vf时为其输出尺寸
+                enc_ctx->height = oopt->height > 0 ? oopt->height : dec_ctx->height;    // 图像高
+                enc_ctx->width = oopt->width > 0 ? oopt->width : dec_ctx->width;        // 图像宽
                 enc_ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio; // 采样宽高比：像素宽/像素高
                 /* take first format from list of supported formats */
                 if (encoder->pix_fmts) { // 编码器支持的像素格式列表
@@ -155,6 +249,9 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
                 enc_ctx->time_base = av_inv_q(dec_ctx->framerate);  // 时基：解码器帧率取倒数
                 enc_ctx->framerate = dec_ctx->framerate;
                 //enc_ctx->bit_rate = dec_ctx->bit_rate;
+                if (oopt->v_bit_rate > 0) {
+                    enc_ctx->bit_rate = oopt->v_bit_rate;
+                }
 
                 /* emit one intra frame every ten frames
                 * check frame pict_type before passing frame
@@ -173,16 +270,11 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
                 enc_ctx->time_base = (AVRational){1, enc_ctx->sample_rate}; // 时基：编码器采样率取倒数
                 // enc_ctx->codec->capabilities |= AV_CODEC_CAP_VARIABLE_FRAME_SIZE; // 只读标志
 
-                // 初始化一个FIFO用于存储待编码的音频帧，初始化FIFO大小的1个采样点
-                // av_audio_fifo_alloc()第二个参数是声道数，第三个参数是单个声道的采样点数
-                // 采样格式及声道数在初始化FIFO时已设置，各处涉及FIFO大小的地方都是用的单个声道的采样点数
-                pp_audio_fifo[i] = av_audio_fifo_alloc(enc_ctx->sample_fmt, enc_ctx->channels, 1);
-                if (pp_audio_fifo == NULL) {
-                    av_log(NULL, AV_LOG_ERROR, "Could not allocate FIFO\n");
-                    return AVERROR(ENOMEM);
-                }
             }
 
+            // 编码线程数需在打开编码器之前设置
+            enc_ctx->thread_count = (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) ? v_threads : a_threads;
+
             // TODO: 这个标志还不懂，以后研究
             if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
                 enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
@@ -195,6 +287,17 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
                 av_log(NULL, AV_LOG_ERROR, "Cannot open video encoder for stream #%u\n", i);
                 return ret;
             }
+            // 初始化一个环形缓冲区用于将解码音频帧重新切分为编码器帧尺寸，编码器打开后frame_size才确定
+            // 容量固定为若干个编码器帧，写入的解码帧更大时分多次写入，各处的大小都是单个声道的采样点数
+            if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && enc_ctx->frame_size > 0) {
+                pp_audio_fifo[i] = av_audio_ring_alloc(enc_ctx->sample_fmt, enc_ctx->channels, enc_ctx->frame_size,
+                                                       enc_ctx->frame_size * AUDIO_RING_FRAMES);
+                if (pp_audio_fifo[i] == NULL) {
+                    av_log(NULL, AV_LOG_ERROR, "Could not allocate FIFO\n");
+                    return AVERROR(ENOMEM);
+                }
+            }
+
             // 3.5 设置输出流codecpar
             ret = avcodec_parameters_from_context(out_stream->codecpar, enc_ctx);
             if (ret < 0) {
@@ -207,22 +310,39 @@ int open_output_file(const char *filename, const inout_ctx_t *ictx,
         } else if (dec_ctx->codec_type == AVMEDIA_TYPE_UNKNOWN) {
             av_log(NULL, AV_LOG_FATAL, "Elementary stream #%d is of unknown type, cannot proceed\n", i);
             return AVERROR_INVALIDDATA;
-        } else {    // 字幕流等
+        } else {    // 字幕流等，及直接复制的音视频流
             /* if this stream must be remuxed */
-            // 3. 将当前输入流中的参数拷贝到输出流中
-            ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+            // 3. 将当前输入流中的参数拷贝到输出流中，若此流经过码流滤镜，则拷贝码流滤镜的输出参数
+            const AVCodecParameters *par = in_stream->codecpar;
+            if (ictx->bsf_ctx && ictx->bsf_ctx[i]) {
+                par = ictx->bsf_ctx[i]->par_out;
+            }
+            ret = avcodec_parameters_copy(out_stream->codecpar, par);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR, "Copying parameters for stream #%u failed\n", i);
                 return ret;
             }
+            // 输入封装格式中的codec_tag在输出封装格式中未必有效，由复用器自行选择
+            out_stream->codecpar->codec_tag = 0;
         }
     }
     av_dump_format(ofmt_ctx, 0, filename, 1);
 
     if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) { // TODO: 研究AVFMT_NOFILE标志 
         // 4. 创建并初始化一个AVIOContext，用以访问URL(out_filename)指定的资源
-        ret = avio_open(&ofmt_ctx->pb, filename, AVIO_FLAG_WRITE);
-        if (ret < 0) {
+        //    本地文件由异步写线程写入，复用器不会因磁盘写入延迟而阻塞，见async_writer.h
+        const char *proto = avio_find_protocol_name(filename);
+        if (proto && strcmp(proto, "file") == 0) {
+            ret = async_writer_open(&octx->writer, filename, oopt->append_pos);
+            if (ret < 0) {
+                async_writer_free(&octx->writer);
+                return ret;
+            }
+            ofmt_ctx->pb = octx->writer->pb;
+        } else if (oopt->append_pos > 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot append to '%s', not a local file\n", filename);
+            return AVERROR(ENOSYS);
+        } else if ((ret = avio_open(&ofmt_ctx->pb, filename, AVIO_FLAG_WRITE)) < 0) {
             av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'", filename);
             return ret;
         }
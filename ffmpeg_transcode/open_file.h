@@ -1,19 +1,49 @@
 #ifndef __OPEN_FILE_H__
 #define __OPEN_FILE_H__
 
+#include <stdbool.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <libavutil/audio_fifo.h>
+#include "async_writer.h"
+#include "av_audio_ring.h"
+#include "avio_mmap.h"
+
+// 音频编码器帧尺寸适配缓冲区的容量，单位是编码器帧
+#define AUDIO_RING_FRAMES   4
 
 typedef struct {
     AVFormatContext* fmt_ctx;
     AVCodecContext** codec_ctx;     // AVCodecContext* codec_ctx[];
+    AVBSFContext** bsf_ctx;         // AVBSFContext* bsf_ctx[]，输入中直接复制(copy)的流可使用码流滤镜，可为NULL
+    async_writer_t* writer;         // 输出到本地文件时fmt_ctx->pb由此创建，否则为NULL
 }   inout_ctx_t;
 
-int open_input_file(const char *filename, inout_ctx_t *ictx);
-int open_output_file(const char *filename, const inout_ctx_t *ictx, 
-                     const char *v_enc_name, const char *a_enc_name,
-                     inout_ctx_t *octx, AVAudioFifo*** afifo);
+// 输出文件参数。一个输入可以对应多个输出文件(如多种分辨率)，每个输出文件各有一组编码器和一个复用器
+typedef struct {
+    const char *fname;
+    int width;                      // 输出图像宽高，0表示与输入(有-vf时为其输出)相同
+    int height;
+    int64_t v_bit_rate;             // 视频码率，0表示使用编码器默认值
+    int64_t append_pos;             // 大于0时保留已有输出文件的前append_pos字节，从此处续写，见checkpoint.h
+}   output_opt_t;
+
+// 按流说明符选择输入流，说明符的写法与ffmpeg的-map相同但不含输入文件序号，见avformat_match_stream_specifier()，
+// 如"1"(序号)、"v"(类型)、"a:1"(第二路音频)、"a:m:language:eng"(英语音频)。与任一说明符匹配的流被选中，
+// nb_maps为0时选中全部流。未选中的流设置AVDISCARD_ALL，在解复用器中即被丢弃。返回选中的流数
+int select_streams(AVFormatContext *fmt_ctx, const char *const *maps, int nb_maps);
+// 选中的流中type类型的最佳流，没有时返回AVERROR_STREAM_NOT_FOUND
+int find_best_mapped_stream(AVFormatContext *fmt_ctx, enum AVMediaType type);
+
+// 用open_media_file()、open_input_file()打开的输入须用avio_mmap_close_input()关闭
+int open_media_file(const char *filename, const char *fmt_name, bool use_mmap, AVFormatContext **fmt_ctx);
+// maps见select_streams()，未选中的流没有AVCodecContext，ictx->codec_ctx中对应项为NULL
+// v_threads/a_threads为音视频编解码器的线程数(AVCodecContext.thread_count)，0表示由库决定
+int open_input_file(const char *filename, const char *fmt_name, bool use_mmap, const char *const *maps, int nb_maps,
+                    bool v_copy, bool a_copy, int v_threads, int a_threads, inout_ctx_t *ictx);
+// 只为ictx->codec_ctx不为NULL的输入流创建输出流，输出流按输入流的顺序排列
+int open_output_file(const output_opt_t *oopt, const inout_ctx_t *ictx, 
+                     const char *v_enc_name, const char *a_enc_name, int v_threads, int a_threads,
+                     inout_ctx_t *octx, av_audio_ring_t*** afifo);
 
 #endif
 
@@ -0,0 +1,221 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include "report.h"
+
+// 转码运行报告：各路流各阶段耗时(总计及百分位数)、队列深度、帧率，以JSON格式输出
+// 根据各阶段耗时可判断转码受限于哪个阶段：编码耗时接近总时长说明编码是瓶颈，
+// 解复用/复用耗时占比高说明受限于I/O。某个队列平均深度接近容量，说明其下游阶段处理不过来
+
+// 输出JSON字符串，转义引号、反斜杠和控制字符
+static void write_json_string(FILE *fp, const char *str) {
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char *)str; p && *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void write_queue(FILE *fp, const av_queue_t *q) {
+    fprintf(fp, "{\"capacity\": %d, \"puts\": %"PRId64", \"avg_depth\": %.2f, \"max_depth\": %d}",
+            q->capacity, q->nb_puts, q->nb_puts > 0 ? (double)q->size_sum / q->nb_puts : 0.0, q->max_size);
+}
+
+static double frame_rate(int64_t nb_frames, int64_t wall_us) {
+    return wall_us > 0 ? nb_frames * 1000000.0 / wall_us : 0.0;
+}
+
+static void write_output_stream(FILE *fp, const transcode_ctx_t *tc, const ostream_ctx_t *ost) {
+    fprintf(fp, "        {\"output\": %d, \"frames\": %"PRId64", \"fps\": %.2f,\n",
+            ost->of->idx, ost->nb_frames, frame_rate(ost->nb_frames, tc->wall_us));
+    if (ost->o_codec_ctx) {
+        fprintf(fp, "         \"encoder\": ");
+        write_json_string(fp, ost->o_codec_ctx->codec->name);
+        fprintf(fp, ",\n         \"encode\": ");
+        stage_stat_write_json(fp, &ost->encode_stat);
+        fprintf(fp, ",\n         \"enc_queue\": ");
+        write_queue(fp, &ost->enc_queue);
+        fprintf(fp, ",\n");
+    }
+    fprintf(fp, "         \"mux\": ");
+    stage_stat_write_json(fp, &ost->mux_stat);
+    fprintf(fp, ",\n         \"mux_queue_wait\": ");
+    stage_stat_write_json(fp, &ost->mux_wait_stat);
+    fprintf(fp, ",\n         \"mux_queue\": ");
+    write_queue(fp, &ost->mux_queue);
+    fprintf(fp, "}");
+}
+
+static void write_stream(FILE *fp, const transcode_ctx_t *tc, const stream_ctx_t *sctx) {
+    const char *type = av_get_media_type_string(sctx->i_stream->codecpar->codec_type);
+
+    fprintf(fp, "    {\"index\": %d, \"type\": ", sctx->stream_idx);
+    write_json_string(fp, type ? type : "unknown");
+    fprintf(fp, ", \"mode\": \"%s\", \"decoded_frames\": %"PRId64", \"decode_fps\": %.2f,\n",
+            sctx->discard ? "discard" : (sctx->i_codec_ctx ? "transcode" : "copy"),
+            sctx->nb_frames, frame_rate(sctx->nb_frames, tc->wall_us));
+    if (sctx->dedup) {
+        fprintf(fp, "     \"dropped_duplicates\": %"PRId64",\n", sctx->dedup->nb_dropped);
+    }
+    fprintf(fp, "     \"demux\": ");
+    stage_stat_write_json(fp, &sctx->demux_stat);
+    fprintf(fp, ",\n");
+    if (sctx->i_codec_ctx) {
+        fprintf(fp, "     \"decode\": ");
+        stage_stat_write_json(fp, &sctx->decode_stat);
+        fprintf(fp, ",\n     \"dec_queue\": ");
+        write_queue(fp, &sctx->dec_queue);
+        fprintf(fp, ",\n");
+    }
+    if (sctx->flt_ctx) {
+        fprintf(fp, "     \"filter\": ");
+        stage_stat_write_json(fp, &sctx->filter_stat);
+        fprintf(fp, ",\n     \"flt_queue\": ");
+        write_queue(fp, &sctx->flt_queue);
+        fprintf(fp, ",\n");
+    }
+    fprintf(fp, "     \"outputs\": [\n");
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        write_output_stream(fp, tc, &tc->outputs[k].osts[sctx->stream_idx]);
+        fprintf(fp, "%s\n", k < tc->nb_outputs - 1 ? "," : "");
+    }
+    fprintf(fp, "     ]}");
+}
+
+static void write_stages(FILE *fp, const char *indent, const stage_stat_t *const *stats) {
+    static const char *const names[] = { "demux", "decode", "filter", "encode", "mux" };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(names); i++) {
+        fprintf(fp, "%s\n%s\"%s\": ", i > 0 ? "," : "", indent, names[i]);
+        stage_stat_write_json(fp, stats[i]);
+    }
+}
+
+// 将转码统计信息写入JSON文件，需在所有阶段线程退出后调用
+int write_report(const transcode_ctx_t *tc, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        int ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Could not open report file %s\n", filename);
+        return ret;
+    }
+
+    fprintf(fp, "{\n  \"input\": ");
+    write_json_string(fp, tc->opt->in_fname);
+    fprintf(fp, ",\n  \"wall_time_us\": %"PRId64",\n", tc->wall_us);
+    fprintf(fp, "  \"packet_pool\": {\"allocs\": %"PRId64", \"gets\": %"PRId64"},\n",
+            tc->pkt_pool.nb_allocs, tc->pkt_pool.nb_gets);
+    fprintf(fp, "  \"frame_pool\": {\"allocs\": %"PRId64", \"gets\": %"PRId64"},\n",
+            tc->frm_pool.nb_allocs, tc->frm_pool.nb_gets);
+
+    fprintf(fp, "  \"threads\": ");
+    thread_plan_write_json(fp, &tc->threads, tc->nb_outputs);
+    fprintf(fp, ",\n");
+
+    fprintf(fp, "  \"outputs\": [");
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        fprintf(fp, "%s", k > 0 ? ", " : "");
+        write_json_string(fp, tc->outputs[k].opt->fname);
+    }
+    fprintf(fp, "],\n");
+
+    // 异步写线程的写入耗时，以及复用线程等待空闲写块的时间
+    fprintf(fp, "  \"output_io\": [");
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        const async_writer_t *w = tc->outputs[k].octx.writer;
+        fprintf(fp, "%s\n    ", k > 0 ? "," : "");
+        if (!w) {
+            fprintf(fp, "null");
+            continue;
+        }
+        fprintf(fp, "{\"bytes\": %"PRId64", \"write\": ", w->size);
+        stage_stat_write_json(fp, &w->write_stat);
+        fprintf(fp, ", \"block_wait\": ");
+        stage_stat_write_json(fp, &w->wait_stat);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n");
+
+    fprintf(fp, "  \"streams\": [\n");
+    for (int i = 0; i < tc->nb_streams; i++) {
+        write_stream(fp, tc, &tc->sctxs[i]);
+        fprintf(fp, "%s\n", i < tc->nb_streams - 1 ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    if (fclose(fp) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write report file %s\n", filename);
+        return AVERROR(EIO);
+    }
+    av_log(NULL, AV_LOG_INFO, "Report written to %s\n", filename);
+
+    return 0;
+}
+
+// 各段并行运行，单段的阶段耗时反映该段受限于编码还是I/O，合计值反映整个任务的瓶颈
+int write_chunk_report(const transcode_opt_t *opt, const transcode_stats_t *const *chunk_stats, int nb_chunks,
+                       int64_t wall_us, int64_t concat_us, const char *filename) {
+    transcode_stats_t *total = av_mallocz(sizeof(transcode_stats_t));
+    FILE *fp;
+
+    if (!total) {
+        return AVERROR(ENOMEM);
+    }
+    fp = fopen(filename, "w");
+    if (!fp) {
+        int ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_ERROR, "Could not open report file %s\n", filename);
+        av_free(total);
+        return ret;
+    }
+
+    fprintf(fp, "{\n  \"input\": ");
+    write_json_string(fp, opt->in_fname);
+    fprintf(fp, ",\n  \"output\": ");
+    write_json_string(fp, opt->outputs[0].fname);
+    fprintf(fp, ",\n  \"wall_time_us\": %"PRId64",\n  \"concat_time_us\": %"PRId64",\n", wall_us, concat_us);
+
+    fprintf(fp, "  \"chunks\": [\n");
+    for (int k = 0; k < nb_chunks; k++) {
+        const transcode_stats_t *s = chunk_stats[k];
+        const stage_stat_t *stages[] = { &s->demux_stat, &s->decode_stat, &s->filter_stat,
+                                         &s->encode_stat, &s->mux_stat };
+        fprintf(fp, "    {\"index\": %d, \"wall_time_us\": %"PRId64", \"video_frames\": %"PRId64", \"fps\": %.2f,",
+                k, s->wall_us, s->nb_video_frames, frame_rate(s->nb_video_frames, s->wall_us));
+        write_stages(fp, "     ", stages);
+        fprintf(fp, "}%s\n", k < nb_chunks - 1 ? "," : "");
+
+        total->nb_video_frames += s->nb_video_frames;
+        stage_stat_merge(&total->demux_stat, &s->demux_stat);
+        stage_stat_merge(&total->decode_stat, &s->decode_stat);
+        stage_stat_merge(&total->filter_stat, &s->filter_stat);
+        stage_stat_merge(&total->encode_stat, &s->encode_stat);
+        stage_stat_merge(&total->mux_stat, &s->mux_stat);
+    }
+    fprintf(fp, "  ],\n");
+
+    const stage_stat_t *stages[] = { &total->demux_stat, &total->decode_stat, &total->filter_stat,
+                                     &total->encode_stat, &total->mux_stat };
+    fprintf(fp, "  \"total\": {\"video_frames\": %"PRId64", \"fps\": %.2f,",
+            total->nb_video_frames, frame_rate(total->nb_video_frames, wall_us));
+    write_stages(fp, "   ", stages);
+    fprintf(fp, "}\n}\n");
+    av_free(total);
+
+    if (fclose(fp) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "Could not write report file %s\n", filename);
+        return AVERROR(EIO);
+    }
+    av_log(NULL, AV_LOG_INFO, "Report written to %s\n", filename);
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include "transcode.h"
+
+int write_report(const transcode_ctx_t *tc, const char *filename);
+// 分块转码的运行报告：各段的耗时、帧率和各阶段耗时，以及所有段合计的各阶段耗时
+// wall_us是从开始切分到拼接完成的总耗时，concat_us是拼接耗时
+int write_chunk_report(const transcode_opt_t *opt, const transcode_stats_t *const *chunk_stats, int nb_chunks,
+                       int64_t wall_us, int64_t concat_us, const char *filename);
+
+#endif
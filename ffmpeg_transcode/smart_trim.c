@@ -0,0 +1,579 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavutil/error.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/time.h>
+#include "av_codec.h"
+#include "smart_trim.h"
+
+// 智能裁剪(smart render)：输出的视频流由三部分拼接而成
+//   head: [start, key_a)    解码起点之前最近的关键帧到key_a之间的帧，重新编码
+//   copy: [key_a, key_b)    区间内完整的GOP，packet直接复制
+//   tail: [key_b, end]      终点所在的不完整GOP，重新编码
+// key_a是区间内第一个关键帧，key_b是区间内最后一个关键帧且其GOP越过终点。起点恰好是关键帧时没有head，
+// 终点恰好在GOP末尾时没有tail。典型的几十秒片段只需重新编码两个GOP
+// 重新编码使用与输入相同的编码格式和参数，不使用B帧(dts与pts相同，拼接处不会出现时间戳交错)，
+// 也不使用全局头，每个重新编码的片段都以带参数集的关键帧开始，与复制的GOP共用输入的流参数
+// 开放GOP中关键帧之后解码、但pts在其之前的前导帧不复制，由相邻的重新编码片段覆盖
+// 所有时间戳减去区间起点
+
+// 一个重新编码的片段
+typedef struct {
+    bool active;                    // 是否需要此片段
+    AVCodecContext *dec_ctx;
+    AVCodecContext *enc_ctx;
+    int64_t feed_pts;               // 从pts为feed_pts的关键帧开始送入解码器，AV_NOPTS_VALUE表示从第一个packet开始
+    int64_t min_pts;                // 只编码pts在[min_pts, max_pts]内的帧，单位是视频流时基
+    int64_t max_pts;
+    bool after_copy;                // 只编码pts大于已复制packet的帧
+    bool feeding;
+    bool done;
+    int64_t nb_frames;              // 重新编码的帧数
+    int64_t encode_us;              // 解码和编码耗时
+}   trim_edge_t;
+
+typedef struct {
+    const transcode_opt_t *opt;
+    AVFormatContext *ifmt_ctx;
+    AVFormatContext *ofmt_ctx;
+    int v_idx;                      // 被裁剪的视频流
+    AVStream *v_st;
+    int64_t start;                  // 区间起点和终点，单位是视频流时基
+    int64_t end;
+    int64_t *offsets;               // int64_t offsets[]，各流的区间起点，单位是各流时基
+    int64_t *ends;                  // int64_t ends[]，各流的区间终点
+    int64_t *last_dts;              // int64_t last_dts[]，各输出流最后写入的dts
+    bool *stream_done;              // bool stream_done[]，各流已越过区间终点
+
+    int64_t key_a;                  // 见文件开头的说明，AV_NOPTS_VALUE表示不存在
+    int64_t key_b;
+    int64_t key_p;                  // key_b之前的关键帧
+    bool tail_open;                 // key_b所在GOP是开放GOP，其前导帧依赖前一个GOP
+
+    bool copy_started;
+    bool copy_done;
+    int64_t copy_max_pts;           // 已复制packet的最大pts
+    int64_t nb_copied;
+    trim_edge_t head;
+    trim_edge_t tail;
+}   trim_ctx_t;
+
+static int64_t packet_pts(const AVPacket *pkt) {
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+// 扫描区间内视频流的关键帧，只读packet不解码，确定key_a、key_b、key_p
+static int scan_keyframes(trim_ctx_t *t) {
+    AVPacket pkt;
+    int64_t cur_key = AV_NOPTS_VALUE, prev_key = AV_NOPTS_VALUE, next_key = AV_NOPTS_VALUE;
+    bool cur_partial = false, cur_open = false;
+    int ret;
+
+    ret = avformat_seek_file(t->ifmt_ctx, t->v_idx, INT64_MIN, t->start, t->start, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Seek to %"PRId64" failed\n", t->start);
+        return ret;
+    }
+
+    av_init_packet(&pkt);
+    while ((ret = av_read_frame(t->ifmt_ctx, &pkt)) >= 0) {
+        int64_t ts = packet_pts(&pkt);
+        bool key = pkt.flags & AV_PKT_FLAG_KEY;
+        bool video = pkt.stream_index == t->v_idx;
+        av_packet_unref(&pkt);
+        if (!video || ts == AV_NOPTS_VALUE) {
+            continue;
+        }
+
+        if (next_key != AV_NOPTS_VALUE) {
+            // 已越过终点：终点之后第一个关键帧的前导帧若在终点之前，则最后一个GOP也不完整
+            if (key || ts > next_key) {
+                break;
+            }
+            if (ts <= t->end) {
+                cur_partial = true;
+            }
+        } else if (key && ts > t->end) {
+            next_key = ts;
+        } else if (key) {
+            prev_key = cur_key;
+            cur_key = ts;
+            cur_partial = false;
+            cur_open = false;
+            if (t->key_a == AV_NOPTS_VALUE && ts >= t->start) {
+                t->key_a = ts;
+            }
+        } else if (cur_key != AV_NOPTS_VALUE) {
+            if (ts > t->end) {
+                cur_partial = true;
+            }
+            if (ts < cur_key) {
+                cur_open = true;
+            }
+        }
+    }
+    if (ret < 0 && ret != AVERROR_EOF) {
+        return ret;
+    }
+
+    if (t->key_a != AV_NOPTS_VALUE && cur_partial) {
+        t->key_b = cur_key;
+        t->key_p = prev_key;
+        t->tail_open = cur_open;
+    }
+
+    // 再次定位到起点之前的关键帧，从此处开始正式处理
+    return avformat_seek_file(t->ifmt_ctx, t->v_idx, INT64_MIN, t->start, t->start, 0);
+}
+
+// H.264/HEVC的参数集若只存放在全局头(avcC/hvcC)中，packet中不含参数集，
+// 重新编码的片段无法与复制的GOP共用一组流参数。MP4/MKV等输入不支持，需先转为Annex B(如TS)
+static bool can_splice(const AVCodecParameters *par) {
+    if (par->codec_id == AV_CODEC_ID_H264 || par->codec_id == AV_CODEC_ID_HEVC) {
+        return !(par->extradata_size > 0 && par->extradata[0] == 1);
+    }
+    return true;
+}
+
+static int open_decoder(const AVStream *st, AVCodecContext **dec_ctx) {
+    AVCodec *dec = avcodec_find_decoder(st->codecpar->codec_id);
+    int ret;
+
+    if (!dec) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to find decoder for stream #%d\n", st->index);
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    *dec_ctx = avcodec_alloc_context3(dec);
+    if (!*dec_ctx) {
+        return AVERROR(ENOMEM);
+    }
+    if ((ret = avcodec_parameters_to_context(*dec_ctx, st->codecpar)) < 0) {
+        return ret;
+    }
+    (*dec_ctx)->pkt_timebase = st->time_base;
+    if ((ret = avcodec_open2(*dec_ctx, dec, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open decoder for stream #%d\n", st->index);
+        return ret;
+    }
+
+    return 0;
+}
+
+// 打开与输入编码格式、参数相同的编码器。opt->v_enc_name是同一编码格式的编码器时使用它，否则使用默认编码器
+static int open_encoder(trim_ctx_t *t, const AVCodecContext *dec_ctx, bool global_header,
+                        AVCodecContext **enc_ctx) {
+    const AVCodecParameters *par = t->v_st->codecpar;
+    AVCodec *encoder = NULL;
+    AVCodecContext *ctx;
+    AVRational frame_rate = av_guess_frame_rate(t->ifmt_ctx, t->v_st, NULL);
+    int ret;
+
+    if (t->opt->v_enc_name && strcmp(t->opt->v_enc_name, "copy") != 0) {
+        encoder = avcodec_find_encoder_by_name(t->opt->v_enc_name);
+        if (encoder && encoder->id != par->codec_id) {
+            encoder = NULL;
+        }
+    }
+    if (!encoder && !(encoder = avcodec_find_encoder(par->codec_id))) {
+        av_log(NULL, AV_LOG_ERROR, "No encoder for %s, smart render is not possible\n",
+               avcodec_get_name(par->codec_id));
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    if (encoder->pix_fmts) {
+        const enum AVPixelFormat *p = encoder->pix_fmts;
+        while (*p != AV_PIX_FMT_NONE && *p != dec_ctx->pix_fmt) {
+            p++;
+        }
+        if (*p == AV_PIX_FMT_NONE) {
+            av_log(NULL, AV_LOG_ERROR, "Encoder %s does not support the input pixel format\n", encoder->name);
+            return AVERROR(ENOSYS);
+        }
+    }
+
+    ctx = *enc_ctx = avcodec_alloc_context3(encoder);
+    if (!ctx) {
+        return AVERROR(ENOMEM);
+    }
+    ctx->width = dec_ctx->width;
+    ctx->height = dec_ctx->height;
+    ctx->pix_fmt = dec_ctx->pix_fmt;
+    ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio;
+    ctx->framerate = frame_rate;
+    ctx->time_base = frame_rate.num > 0 ? av_inv_q(frame_rate) : t->v_st->time_base;
+    ctx->bit_rate = par->bit_rate > 0 ? par->bit_rate : t->ifmt_ctx->bit_rate;
+    ctx->profile = par->profile;
+    ctx->level = par->level;
+    ctx->field_order = par->field_order;
+    ctx->color_range = par->color_range;
+    ctx->color_primaries = par->color_primaries;
+    ctx->color_trc = par->color_trc;
+    ctx->colorspace = par->color_space;
+    ctx->chroma_sample_location = par->chroma_location;
+    ctx->max_b_frames = 0;
+    ctx->thread_count = t->opt->nb_cores;
+    if (global_header) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if ((ret = avcodec_open2(ctx, encoder, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open encoder %s\n", encoder->name);
+        return ret;
+    }
+
+    return 0;
+}
+
+// 写一个时间戳已减去区间起点的packet，tb是其时间戳的时基。packet的引用由本函数释放
+static int write_packet(trim_ctx_t *t, AVPacket *pkt, AVRational tb) {
+    int idx = pkt->stream_index;
+    int ret;
+
+    av_packet_rescale_ts(pkt, tb, t->ofmt_ctx->streams[idx]->time_base);
+    pkt->pos = -1;
+    // 重新编码的GOP没有B帧，与之后直接复制的GOP拼接处dts可能不递增
+    av_packet_fix_seam_dts(pkt, &t->last_dts[idx]);
+    ret = av_interleaved_write_frame(t->ofmt_ctx, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "write frame error %d\n", ret);
+    }
+
+    return ret;
+}
+
+// 直接复制一个packet，不改变pkt
+static int copy_packet(trim_ctx_t *t, const AVPacket *pkt) {
+    AVPacket opkt;
+    int ret;
+
+    av_init_packet(&opkt);
+    if ((ret = av_packet_ref(&opkt, pkt)) < 0) {
+        return ret;
+    }
+    if (opkt.pts != AV_NOPTS_VALUE) {
+        opkt.pts -= t->offsets[pkt->stream_index];
+    }
+    if (opkt.dts != AV_NOPTS_VALUE) {
+        opkt.dts -= t->offsets[pkt->stream_index];
+    }
+
+    return write_packet(t, &opkt, t->ifmt_ctx->streams[pkt->stream_index]->time_base);
+}
+
+// 编码一帧，frame为NULL表示冲洗编码器
+static int encode_frame(trim_ctx_t *t, trim_edge_t *e, AVFrame *frame) {
+    AVPacket pkt;
+    int ret;
+
+    if (frame) {
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        frame->pts = av_rescale_q(frame->pts - t->start, t->v_st->time_base, e->enc_ctx->time_base);
+        e->nb_frames++;
+    }
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    ret = av_encode_frame(e->enc_ctx, frame, &pkt);
+    while (ret == 0) {
+        pkt.stream_index = t->v_idx;
+        if ((ret = write_packet(t, &pkt, e->enc_ctx->time_base)) < 0) {
+            return ret;
+        }
+        ret = avcodec_receive_packet(e->enc_ctx, &pkt);
+    }
+
+    return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+// 解码一个packet并编码其中落在片段区间内的帧，pkt为NULL表示冲洗解码器
+// 解码出的帧越过片段终点后，片段结束，冲洗编码器
+static int decode_edge(trim_ctx_t *t, trim_edge_t *e, AVPacket *pkt) {
+    AVPacket flush_pkt = { .data = NULL, .size = 0 };
+    bool new_packet = true;
+    int64_t t0 = av_gettime_relative();
+    AVFrame *frame = av_frame_alloc();
+    int ret;
+
+    if (!frame) {
+        return AVERROR(ENOMEM);
+    }
+    while (!e->done) {
+        ret = av_decode_frame(e->dec_ctx, pkt ? pkt : &flush_pkt, &new_packet, frame);
+        if (ret == AVERROR(EAGAIN)) {
+            break;
+        } else if (ret == AVERROR_EOF) {
+            e->done = true;
+        } else if (ret < 0) {
+            goto end;
+        } else if (frame->pts > e->max_pts) {
+            e->done = true;
+        } else if (frame->pts >= e->min_pts && (!e->after_copy || frame->pts > t->copy_max_pts)) {
+            ret = encode_frame(t, e, frame);
+            if (ret < 0) {
+                goto end;
+            }
+        }
+        av_frame_unref(frame);
+    }
+    ret = e->done ? encode_frame(t, e, NULL) : 0;
+
+end:
+    av_frame_free(&frame);
+    e->encode_us += av_gettime_relative() - t0;
+    return ret;
+}
+
+static int feed_edge(trim_ctx_t *t, trim_edge_t *e, AVPacket *pkt) {
+    if (!e->active || e->done) {
+        return 0;
+    }
+    if (!e->feeding) {
+        if (e->feed_pts != AV_NOPTS_VALUE &&
+            !((pkt->flags & AV_PKT_FLAG_KEY) && packet_pts(pkt) == e->feed_pts)) {
+            return 0;
+        }
+        e->feeding = true;
+    }
+
+    return decode_edge(t, e, pkt);
+}
+
+// 处理一个视频packet：依次复制、送入head、送入tail
+static int process_video_packet(trim_ctx_t *t, AVPacket *pkt) {
+    bool key = pkt->flags & AV_PKT_FLAG_KEY;
+    int64_t ts = packet_pts(pkt);
+    int ret;
+
+    if (t->key_a != AV_NOPTS_VALUE && !t->copy_done && ts != AV_NOPTS_VALUE) {
+        if (key && ts == t->key_a) {
+            t->copy_started = true;
+        } else if (t->copy_started && key && (ts == t->key_b || ts > t->end)) {
+            t->copy_done = true;
+        }
+        if (t->copy_started && !t->copy_done && ts >= t->key_a && ts <= t->end) {
+            if ((ret = copy_packet(t, pkt)) < 0) {
+                return ret;
+            }
+            t->copy_max_pts = FFMAX(t->copy_max_pts, ts);
+            t->nb_copied++;
+        }
+    }
+    if ((ret = feed_edge(t, &t->head, pkt)) < 0) {
+        return ret;
+    }
+
+    return feed_edge(t, &t->tail, pkt);
+}
+
+static bool all_done(const trim_ctx_t *t) {
+    if ((t->head.active && !t->head.done) || (t->tail.active && !t->tail.done) ||
+        (t->key_a != AV_NOPTS_VALUE && !t->copy_done)) {
+        return false;
+    }
+    for (unsigned int i = 0; i < t->ifmt_ctx->nb_streams; i++) {
+        // 字幕等稀疏流不等待，否则可能一直读到文件末尾
+        if (t->ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && !t->stream_done[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int process(trim_ctx_t *t) {
+    AVPacket pkt;
+    int ret;
+
+    av_init_packet(&pkt);
+    while (!all_done(t)) {
+        ret = av_read_frame(t->ifmt_ctx, &pkt);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            return ret;
+        }
+
+        int idx = pkt.stream_index;
+        int64_t ts = packet_pts(&pkt);
+        if (idx == t->v_idx) {
+            ret = process_video_packet(t, &pkt);
+        } else if (!t->stream_done[idx] && ts != AV_NOPTS_VALUE) {
+            if (ts > t->ends[idx]) {
+                t->stream_done[idx] = true;
+            } else if (ts >= t->offsets[idx]) {
+                ret = copy_packet(t, &pkt);
+            }
+        }
+        av_packet_unref(&pkt);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    // 读到文件末尾时冲洗尚未结束的片段
+    if ((ret = (t->head.active && !t->head.done) ? decode_edge(t, &t->head, NULL) : 0) < 0) {
+        return ret;
+    }
+    return (t->tail.active && !t->tail.done) ? decode_edge(t, &t->tail, NULL) : 0;
+}
+
+// 1. 确定区间，扫描关键帧，确定各片段
+// 2. 创建输出文件：视频流与输入共用流参数，只有head一个片段时使用编码器的参数
+// 3. 读取区间内的packet，复制或重新编码
+static int init_trim(trim_ctx_t *t) {
+    AVFormatContext *ifmt_ctx = t->ifmt_ctx;
+    unsigned int nb_streams = ifmt_ctx->nb_streams;
+    int64_t in_start = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+    int64_t start_us = in_start + (t->opt->trim_start != AV_NOPTS_VALUE ? t->opt->trim_start : 0);
+    int64_t end_us = t->opt->trim_end != AV_NOPTS_VALUE ? in_start + t->opt->trim_end : INT64_MAX;
+    AVRational tb;
+    int ret;
+
+    t->offsets = av_mallocz_array(nb_streams, sizeof(int64_t));
+    t->ends = av_mallocz_array(nb_streams, sizeof(int64_t));
+    t->last_dts = av_mallocz_array(nb_streams, sizeof(int64_t));
+    t->stream_done = av_mallocz_array(nb_streams, sizeof(bool));
+    if (!t->offsets || !t->ends || !t->last_dts || !t->stream_done) {
+        return AVERROR(ENOMEM);
+    }
+    for (unsigned int i = 0; i < nb_streams; i++) {
+        tb = ifmt_ctx->streams[i]->time_base;
+        t->offsets[i] = av_rescale_q(start_us, AV_TIME_BASE_Q, tb);
+        t->ends[i] = end_us == INT64_MAX ? INT64_MAX : av_rescale_q(end_us, AV_TIME_BASE_Q, tb);
+        t->last_dts[i] = AV_NOPTS_VALUE;
+    }
+
+    // 1
+    t->v_idx = av_find_best_stream(ifmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (t->v_idx < 0) {
+        av_log(NULL, AV_LOG_ERROR, "No video stream\n");
+        return t->v_idx;
+    }
+    t->v_st = ifmt_ctx->streams[t->v_idx];
+    t->start = t->offsets[t->v_idx];
+    t->end = t->ends[t->v_idx];
+    t->key_a = t->key_b = t->key_p = AV_NOPTS_VALUE;
+    t->copy_max_pts = INT64_MIN;
+    if (!can_splice(t->v_st->codecpar)) {
+        av_log(NULL, AV_LOG_ERROR, "Parameter sets of stream #%d are out of band (avcC/hvcC), "
+               "smart render needs Annex B input such as MPEG-TS\n", t->v_idx);
+        return AVERROR(ENOSYS);
+    }
+    if ((ret = scan_keyframes(t)) < 0) {
+        return ret;
+    }
+
+    t->head.active = t->key_a == AV_NOPTS_VALUE || t->key_a > t->start;
+    t->head.feed_pts = AV_NOPTS_VALUE;
+    t->head.min_pts = t->start;
+    t->head.max_pts = t->key_a != AV_NOPTS_VALUE ? t->key_a - 1 : t->end;
+    t->tail.active = t->key_b != AV_NOPTS_VALUE;
+    t->tail.feed_pts = (t->tail_open && t->key_p != AV_NOPTS_VALUE) ? t->key_p : t->key_b;
+    t->tail.max_pts = t->end;
+    t->tail.after_copy = true;
+    // 区间内只有一个关键帧且其GOP越过终点时没有可复制的GOP，key_a之前的帧由head编码
+    t->copy_done = t->key_a != AV_NOPTS_VALUE && t->key_a == t->key_b;
+    t->tail.min_pts = t->copy_done ? t->key_b : t->start;
+    av_log(NULL, AV_LOG_INFO, "Smart render of stream #%d: range [%"PRId64", %"PRId64"], "
+           "copy from key frame %"PRId64" to %"PRId64", head %s, tail %s\n",
+           t->v_idx, t->start, t->end, t->key_a, t->key_b,
+           t->head.active ? "re-encoded" : "none", t->tail.active ? "re-encoded" : "none");
+
+    // 2
+    avformat_alloc_output_context2(&t->ofmt_ctx, NULL, NULL, t->opt->outputs[0].fname);
+    if (!t->ofmt_ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Could not create output context\n");
+        return AVERROR_UNKNOWN;
+    }
+    bool global_header = t->key_a == AV_NOPTS_VALUE && (t->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER);
+    trim_edge_t *edges[2] = { &t->head, &t->tail };
+    for (int k = 0; k < 2; k++) {
+        if (!edges[k]->active) {
+            continue;
+        }
+        if ((ret = open_decoder(t->v_st, &edges[k]->dec_ctx)) < 0 ||
+            (ret = open_encoder(t, edges[k]->dec_ctx, global_header, &edges[k]->enc_ctx)) < 0) {
+            return ret;
+        }
+    }
+    for (unsigned int i = 0; i < nb_streams; i++) {
+        AVStream *in_stream = ifmt_ctx->streams[i];
+        AVStream *out_stream = avformat_new_stream(t->ofmt_ctx, NULL);
+        if (!out_stream) {
+            return AVERROR(ENOMEM);
+        }
+        if ((int)i == t->v_idx && t->key_a == AV_NOPTS_VALUE) {
+            ret = avcodec_parameters_from_context(out_stream->codecpar, t->head.enc_ctx);
+        } else {
+            ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+            out_stream->codecpar->codec_tag = 0;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        out_stream->time_base = in_stream->time_base;
+    }
+    if (!(t->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&t->ofmt_ctx->pb, t->opt->outputs[0].fname, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'", t->opt->outputs[0].fname);
+            return ret;
+        }
+    }
+    if ((ret = avformat_write_header(t->ofmt_ctx, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error occurred when opening output file\n");
+        return ret;
+    }
+
+    return 0;
+}
+
+static void deinit_trim(trim_ctx_t *t) {
+    trim_edge_t *edges[2] = { &t->head, &t->tail };
+    for (int k = 0; k < 2; k++) {
+        avcodec_free_context(&edges[k]->dec_ctx);
+        avcodec_free_context(&edges[k]->enc_ctx);
+    }
+    if (t->ofmt_ctx && !(t->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&t->ofmt_ctx->pb);
+    }
+    avformat_free_context(t->ofmt_ctx);
+    avio_mmap_close_input(&t->ifmt_ctx);
+    av_free(t->offsets);
+    av_free(t->ends);
+    av_free(t->last_dts);
+    av_free(t->stream_done);
+}
+
+int transcode_smart_trim(const transcode_opt_t *opt) {
+    trim_ctx_t t;
+    int ret;
+
+    memset(&t, 0, sizeof(t));
+    t.opt = opt;
+    if (opt->nb_outputs != 1) {
+        av_log(NULL, AV_LOG_ERROR, "Smart render supports only one output\n");
+        return AVERROR(EINVAL);
+    }
+
+    if ((ret = open_media_file(opt->in_fname, opt->in_fmt_name, opt->in_mmap, &t.ifmt_ctx)) < 0 ||
+        (ret = init_trim(&t)) < 0) {
+        goto end;
+    }
+    if ((ret = process(&t)) < 0) {
+        goto end;
+    }
+    ret = av_write_trailer(t.ofmt_ctx);
+
+    av_log(NULL, AV_LOG_INFO, "Smart render: %"PRId64" packets copied, %"PRId64" + %"PRId64" frames "
+           "re-encoded in %.1f ms\n", t.nb_copied, t.head.nb_frames, t.tail.nb_frames,
+           (t.head.encode_us + t.tail.encode_us) / 1000.0);
+
+end:
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Smart render failed: %s\n", av_err2str(ret));
+    }
+    deinit_trim(&t);
+
+    return ret;
+}
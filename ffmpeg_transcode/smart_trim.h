@@ -0,0 +1,10 @@
+#ifndef __SMART_TRIM_H__
+#define __SMART_TRIM_H__
+
+#include "transcode.h"
+
+// 智能裁剪：截取输入中[opt->trim_start, opt->trim_end]区间，区间内完整的GOP直接复制，
+// 只有切点所在的不完整GOP解码后重新编码。只支持一个输出文件，音频等其他流直接复制，不支持-map
+int transcode_smart_trim(const transcode_opt_t *opt);
+
+#endif
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/log.h>
+#include "thread_plan.h"
+
+// 单个编解码器的线程数上限，超过后帧级并行带来的延迟和内存开销大于收益
+#define MAX_CODEC_THREADS   16
+
+// nb_cores为0时使用本机全部核
+// 1. 预算较多时为解复用、复用、音频等流水线线程预留一个核
+// 2. 视频解码分得约1/4，视频滤镜图每8个核分得1个线程
+// 3. 其余按各输出的像素数比例分给视频编码器，未指定尺寸的输出与输入尺寸相同，按最大的输出计
+void thread_plan_init(thread_plan_t *plan, int nb_cores, const output_opt_t *outputs, int nb_outputs) {
+    double weights[MAX_FILTER_OUTPUTS], max_weight = 0, sum_weight = 0;
+    int avail;
+
+    memset(plan, 0, sizeof(thread_plan_t));
+    plan->nb_cores = nb_cores > 0 ? nb_cores : av_cpu_count();
+    plan->a_dec_threads = 1;
+    plan->a_enc_threads = 1;
+    plan->a_filter_threads = 1;
+
+    // 1
+    avail = plan->nb_cores >= 4 ? plan->nb_cores - 1 : plan->nb_cores;
+
+    // 2
+    plan->v_dec_threads = av_clip(avail / 4, 1, MAX_CODEC_THREADS);
+    plan->v_filter_threads = FFMAX(avail / 8, 1);
+    avail = FFMAX(avail - plan->v_dec_threads - plan->v_filter_threads, nb_outputs);
+
+    // 3
+    for (int k = 0; k < nb_outputs; k++) {
+        weights[k] = (double)outputs[k].width * outputs[k].height;
+        max_weight = FFMAX(max_weight, weights[k]);
+    }
+    for (int k = 0; k < nb_outputs; k++) {
+        if (weights[k] <= 0) {
+            weights[k] = max_weight > 0 ? max_weight : 1;
+        }
+        sum_weight += weights[k];
+    }
+    for (int k = 0; k < nb_outputs; k++) {
+        int threads = (int)(avail * weights[k] / sum_weight + 0.5);
+        plan->v_enc_threads[k] = av_clip(threads, 1, MAX_CODEC_THREADS);
+    }
+}
+
+void thread_plan_log(const thread_plan_t *plan, int nb_outputs) {
+    av_log(NULL, AV_LOG_INFO, "Thread plan for %d cores: video decoder %d, video filter %d, "
+           "audio decoder %d, audio encoder %d, video encoders",
+           plan->nb_cores, plan->v_dec_threads, plan->v_filter_threads,
+           plan->a_dec_threads, plan->a_enc_threads);
+    for (int k = 0; k < nb_outputs; k++) {
+        av_log(NULL, AV_LOG_INFO, " %d", plan->v_enc_threads[k]);
+    }
+    av_log(NULL, AV_LOG_INFO, "\n");
+}
+
+void thread_plan_write_json(FILE *fp, const thread_plan_t *plan, int nb_outputs) {
+    fprintf(fp, "{\"cores\": %d, \"video_decoder\": %d, \"audio_decoder\": %d, "
+            "\"video_filter\": %d, \"audio_filter\": %d, \"audio_encoder\": %d, \"video_encoders\": [",
+            plan->nb_cores, plan->v_dec_threads, plan->a_dec_threads,
+            plan->v_filter_threads, plan->a_filter_threads, plan->a_enc_threads);
+    for (int k = 0; k < nb_outputs; k++) {
+        fprintf(fp, "%s%d", k > 0 ? ", " : "", plan->v_enc_threads[k]);
+    }
+    fprintf(fp, "]}");
+}
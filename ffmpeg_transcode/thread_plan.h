@@ -0,0 +1,27 @@
+#ifndef __THREAD_PLAN_H__
+#define __THREAD_PLAN_H__
+
+#include <stdio.h>
+#include "av_filter.h"
+#include "open_file.h"
+
+// 按核预算分配各编解码器和滤镜图的线程数
+// 同一台机器上运行多个转码任务时，各编解码器按库的默认值(通常是CPU核数)各自创建线程，线程总数远超核数，
+// 频繁切换反而降低吞吐。这里给整个任务一个核预算，由视频解码器、各输出的视频编码器和视频滤镜图分摊：
+// 音频编解码开销小，不开额外线程；视频编码开销最大，按输出分辨率的像素数比例分得剩余的核
+// 线程数为1表示不使用编解码器内部线程，只在流水线本身的线程中运行
+typedef struct {
+    int nb_cores;                   // 本任务的核预算
+    int v_dec_threads;              // 视频解码器AVCodecContext.thread_count
+    int a_dec_threads;              // 音频解码器AVCodecContext.thread_count
+    int v_enc_threads[MAX_FILTER_OUTPUTS];  // 各输出视频编码器AVCodecContext.thread_count
+    int a_enc_threads;              // 音频编码器AVCodecContext.thread_count
+    int v_filter_threads;           // 视频滤镜图AVFilterGraph.nb_threads
+    int a_filter_threads;           // 音频滤镜图AVFilterGraph.nb_threads
+}   thread_plan_t;
+
+void thread_plan_init(thread_plan_t *plan, int nb_cores, const output_opt_t *outputs, int nb_outputs);
+void thread_plan_log(const thread_plan_t *plan, int nb_outputs);
+void thread_plan_write_json(FILE *fp, const thread_plan_t *plan, int nb_outputs);
+
+#endif
@@ -0,0 +1,450 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL2/SDL_thread.h>
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/cpu.h>
+#include <libavutil/error.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+#include "av_codec.h"
+#include "thumbnail.h"
+
+// 逐帧解码取100张缩略图，解码量是每个时间点只解码一个关键帧的上百倍。这里：
+// 1. 每个时间点seek到其之前最近的关键帧，解复用层丢弃非关键帧(AVStream.discard = AVDISCARD_NONKEY)，
+//    不支持此设置的封装格式由读取循环跳过非关键帧，解码器也设置skip_frame = AVDISCARD_NONKEY
+// 2. 时间点按顺序分成连续的几段，每个工作线程打开自己的输入和解码器处理一段，段内seek只向前
+// 3. 每个工作线程复用一个SwsContext，缩放结果直接写入拼图中对应的格子。格子互不重叠，不需要加锁
+// 4. 相邻时间点落在同一个GOP时seek到同一个关键帧，直接复用上一次解码的帧
+// 解码器单线程运行：帧级多线程解码器要缓存多个packet才输出第一帧，并行由多个工作线程完成
+
+typedef struct thumb_ctx_t thumb_ctx_t;
+
+typedef struct {
+    thumb_ctx_t *tc;
+    int first;                      // 负责的时间点[first, last)
+    int last;
+    SDL_Thread *tid;
+    int ret;
+    int nb_decoded;                 // 实际解码的关键帧数
+    int64_t decode_us;              // seek、解码和缩放的耗时
+}   thumb_worker_t;
+
+struct thumb_ctx_t {
+    const transcode_opt_t *opt;
+    int v_idx;                      // 取缩略图的视频流
+    int64_t start;                  // 取样区间，单位AV_TIME_BASE，已加上输入的start_time
+    int64_t end;
+    int nb_thumbs;
+    int width;                      // 缩略图尺寸
+    int height;
+    int cols;                       // 每张拼图的列数和行数
+    int rows;
+    int nb_sheets;
+    AVFrame **sheets;               // AVFrame* sheets[]
+    AVCodecContext *enc_ctx;        // 拼图的图片编码器，拼图的像素格式即其输入格式
+
+    thumb_worker_t workers[MAX_THUMB_WORKERS];
+    int nb_workers;
+};
+
+// 第k个时间点，取各等分区间的中点，避开输入开头的黑场和结尾
+static int64_t thumb_ts(const thumb_ctx_t *tc, int k) {
+    return tc->start + av_rescale(tc->end - tc->start, 2 * k + 1, 2 * tc->nb_thumbs);
+}
+
+// 第k个缩略图在拼图中的格子：各平面的起始地址，行跨度与拼图相同
+static void tile_pointers(const thumb_ctx_t *tc, int k, uint8_t *dst[4], int dst_linesize[4]) {
+    AVFrame *sheet = tc->sheets[k / (tc->cols * tc->rows)];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(sheet->format);
+    int idx = k % (tc->cols * tc->rows);
+    int x = idx % tc->cols * tc->width;
+    int y = idx / tc->cols * tc->height;
+
+    for (int p = 0; p < 4; p++) {
+        bool chroma = (p == 1 || p == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        dst[p] = NULL;
+        dst_linesize[p] = sheet->linesize[p];
+        if (sheet->data[p]) {
+            // 缩略图宽高为偶数，格子的位置在色度平面上不会落在半个像素处
+            dst[p] = sheet->data[p] + (chroma ? y >> desc->log2_chroma_h : y) * sheet->linesize[p] +
+                     av_image_get_linesize(sheet->format, x, p);
+        }
+    }
+}
+
+static void close_input(inout_ctx_t *ictx) {
+    if (ictx->codec_ctx) {
+        for (unsigned int i = 0; i < ictx->fmt_ctx->nb_streams; i++) {
+            avcodec_free_context(&ictx->codec_ctx[i]);
+        }
+        av_freep(&ictx->codec_ctx);
+    }
+    avio_mmap_close_input(&ictx->fmt_ctx);
+}
+
+// 1. seek到第k个时间点之前最近的关键帧
+// 2. 读到的第一个关键帧与上一个时间点相同时，直接复用frame中上一次解码的帧，返回1
+// 3. 送入关键帧直到解码器输出一帧，返回0。读到文件末尾时冲洗解码器
+static int grab_keyframe(thumb_ctx_t *tc, inout_ctx_t *ictx, int k, AVPacket *pkt, AVFrame *frame,
+                         int64_t *last_key) {
+    AVFormatContext *fmt_ctx = ictx->fmt_ctx;
+    AVCodecContext *dec_ctx = ictx->codec_ctx[tc->v_idx];
+    int64_t ts = av_rescale_q(thumb_ts(tc, k), AV_TIME_BASE_Q, fmt_ctx->streams[tc->v_idx]->time_base);
+    bool first = true;
+    bool eof = false;
+    int ret;
+
+    // 1
+    if ((ret = avformat_seek_file(fmt_ctx, tc->v_idx, INT64_MIN, ts, ts, 0)) < 0) {
+        return ret;
+    }
+    avcodec_flush_buffers(dec_ctx);
+
+    while (1) {
+        bool new_packet = true;
+        ret = av_read_frame(fmt_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            eof = true;
+        } else if (ret < 0) {
+            return ret;
+        } else if (pkt->stream_index != tc->v_idx || !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        } else if (first) {
+            // 2
+            first = false;
+            if (frame->data[0] && pkt->pts != AV_NOPTS_VALUE && pkt->pts == *last_key) {
+                av_packet_unref(pkt);
+                return 1;
+            }
+            *last_key = pkt->pts;
+        }
+
+        // 3
+        ret = av_decode_frame(dec_ctx, eof ? NULL : pkt, &new_packet, frame);
+        av_packet_unref(pkt);
+        if (ret == AVERROR(EAGAIN) && !eof) {
+            continue;
+        }
+        *last_key = ret == 0 ? *last_key : AV_NOPTS_VALUE;
+        return ret == AVERROR(EAGAIN) ? AVERROR_EOF : ret;
+    }
+}
+
+// 1. 打开输入，只选中视频流并只解码其关键帧，其他流在解复用器中丢弃
+// 2. 依次取各时间点的关键帧，缩放后写入拼图中的格子
+static int worker_thread(void *arg) {
+    thumb_worker_t *w = arg;
+    thumb_ctx_t *tc = w->tc;
+    const transcode_opt_t *opt = tc->opt;
+    inout_ctx_t ictx = { 0 };
+    struct SwsContext *sws_ctx = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    int64_t last_key = AV_NOPTS_VALUE;
+    char v_map[16];
+    const char *maps[1] = { v_map };
+    int ret;
+
+    if (!pkt || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    // 1
+    snprintf(v_map, sizeof(v_map), "%d", tc->v_idx);
+    ret = open_input_file(opt->in_fname, opt->in_fmt_name, opt->in_mmap, maps, 1, false, true, 1, 0, &ictx);
+    if (ret < 0) {
+        goto end;
+    }
+    ictx.fmt_ctx->streams[tc->v_idx]->discard = AVDISCARD_NONKEY;
+    ictx.codec_ctx[tc->v_idx]->skip_frame = AVDISCARD_NONKEY;
+
+    // 2
+    for (int k = w->first; k < w->last; k++) {
+        uint8_t *dst[4];
+        int dst_linesize[4];
+        int64_t t0 = av_gettime_relative();
+
+        if ((ret = grab_keyframe(tc, &ictx, k, pkt, frame, &last_key)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot decode thumbnail #%d: %s\n", k, av_err2str(ret));
+            goto end;
+        }
+        w->nb_decoded += ret == 0;
+
+        // 输入中途改变分辨率时sws_getCachedContext()才重新创建SwsContext
+        sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, frame->format,
+                                       tc->width, tc->height, tc->enc_ctx->pix_fmt,
+                                       SWS_BICUBIC, NULL, NULL, NULL);
+        if (!sws_ctx) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot initialize the conversion context\n");
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        tile_pointers(tc, k, dst, dst_linesize);
+        sws_scale(sws_ctx, (const uint8_t * const *)frame->data, frame->linesize, 0, frame->height,
+                  dst, dst_linesize);
+        w->decode_us += av_gettime_relative() - t0;
+    }
+    ret = 0;
+
+end:
+    w->ret = ret;
+    sws_freeContext(sws_ctx);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    close_input(&ictx);
+
+    return 0;
+}
+
+// 按输出文件扩展名选择图片编码器(与image2复用器相同)，采用其支持的第一种像素格式
+static int open_encoder(thumb_ctx_t *tc, const char *filename) {
+    enum AVCodecID id = av_guess_codec(av_guess_format("image2", NULL, NULL), NULL, filename, NULL,
+                                       AVMEDIA_TYPE_VIDEO);
+    AVCodec *encoder = avcodec_find_encoder(id);
+    AVCodecContext *enc_ctx;
+    int ret;
+
+    if (!encoder || !encoder->pix_fmts) {
+        av_log(NULL, AV_LOG_ERROR, "No image encoder for '%s'\n", filename);
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    enc_ctx = tc->enc_ctx = avcodec_alloc_context3(encoder);
+    if (!enc_ctx) {
+        return AVERROR(ENOMEM);
+    }
+    enc_ctx->width = tc->cols * tc->width;
+    enc_ctx->height = tc->rows * tc->height;
+    enc_ctx->pix_fmt = encoder->pix_fmts[0];
+    enc_ctx->time_base = (AVRational){1, 1};
+    // JPEG使用固定量化参数，相当于ffmpeg -q:v 3
+    enc_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    enc_ctx->global_quality = FF_QP2LAMBDA * 3;
+    if ((ret = avcodec_open2(enc_ctx, encoder, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open image encoder %s\n", encoder->name);
+        return ret;
+    }
+
+    return 0;
+}
+
+// 分配全部拼图并填充黑色，最后一张拼图中未用到的格子保持黑色
+static int alloc_sheets(thumb_ctx_t *tc) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(tc->enc_ctx->pix_fmt);
+    int ret;
+
+    tc->sheets = av_mallocz_array(tc->nb_sheets, sizeof(AVFrame *));
+    if (!tc->sheets) {
+        return AVERROR(ENOMEM);
+    }
+    for (int s = 0; s < tc->nb_sheets; s++) {
+        AVFrame *sheet = tc->sheets[s] = av_frame_alloc();
+        if (!sheet) {
+            return AVERROR(ENOMEM);
+        }
+        sheet->format = tc->enc_ctx->pix_fmt;
+        sheet->width = tc->enc_ctx->width;
+        sheet->height = tc->enc_ctx->height;
+        sheet->quality = tc->enc_ctx->global_quality;
+        if ((ret = av_frame_get_buffer(sheet, 0)) < 0) {
+            return ret;
+        }
+        for (int p = 0; p < 4 && sheet->data[p]; p++) {
+            bool chroma = (p == 1 || p == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+            int h = chroma ? AV_CEIL_RSHIFT(sheet->height, desc->log2_chroma_h) : sheet->height;
+            memset(sheet->data[p], chroma ? 128 : 0, (size_t)sheet->linesize[p] * h);
+        }
+    }
+
+    return 0;
+}
+
+// 1. 读取输入的视频流参数和时长，确定取样区间、缩略图尺寸和拼图布局
+// 2. 打开图片编码器，分配拼图
+static int init_thumbnails(thumb_ctx_t *tc) {
+    const transcode_opt_t *opt = tc->opt;
+    const output_opt_t *oopt = &opt->outputs[0];
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecParameters *par;
+    AVRational sar;
+    char fname[1024];
+    int ret;
+
+    // 1
+    if ((ret = open_media_file(opt->in_fname, opt->in_fmt_name, opt->in_mmap, &fmt_ctx)) < 0) {
+        return ret;
+    }
+    if ((ret = select_streams(fmt_ctx, opt->maps, opt->nb_maps)) < 0) {
+        goto end;
+    }
+    if ((ret = find_best_mapped_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "No video stream in %s\n", opt->in_fname);
+        goto end;
+    }
+    tc->v_idx = ret;
+    par = fmt_ctx->streams[tc->v_idx]->codecpar;
+    sar = av_guess_sample_aspect_ratio(fmt_ctx, fmt_ctx->streams[tc->v_idx], NULL);
+    if (sar.num <= 0 || sar.den <= 0) {
+        sar = (AVRational){1, 1};
+    }
+
+    tc->start = opt->trim_start != AV_NOPTS_VALUE ? opt->trim_start : 0;
+    tc->end = fmt_ctx->duration;
+    if (opt->trim_end != AV_NOPTS_VALUE && (tc->end == AV_NOPTS_VALUE || opt->trim_end < tc->end)) {
+        tc->end = opt->trim_end;
+    }
+    if (tc->end == AV_NOPTS_VALUE || tc->end <= tc->start) {
+        av_log(NULL, AV_LOG_ERROR, "Unknown or empty duration of %s\n", opt->in_fname);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (fmt_ctx->start_time != AV_NOPTS_VALUE) {
+        tc->start += fmt_ctx->start_time;
+        tc->end += fmt_ctx->start_time;
+    }
+
+    // 宽高取偶数，YUV 4:2:0拼图中格子的位置和大小在色度平面上都是整数
+    tc->nb_thumbs = opt->nb_thumbs;
+    tc->width = (oopt->width > 0 ? oopt->width : THUMB_DEFAULT_WIDTH) & ~1;
+    tc->height = oopt->height > 0 ? oopt->height :
+                 (int)av_rescale(tc->width, (int64_t)par->height * sar.den, (int64_t)par->width * sar.num);
+    tc->height &= ~1;
+    if (tc->width <= 0 || tc->height <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid thumbnail size %dx%d\n", tc->width, tc->height);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    tc->cols = FFMIN(opt->thumb_cols > 0 ? opt->thumb_cols : THUMB_DEFAULT_COLS, tc->nb_thumbs);
+    tc->rows = (tc->nb_thumbs + tc->cols - 1) / tc->cols;
+    if (opt->thumb_rows > 0) {
+        tc->rows = FFMIN(tc->rows, opt->thumb_rows);
+    }
+    tc->nb_sheets = (tc->nb_thumbs + tc->cols * tc->rows - 1) / (tc->cols * tc->rows);
+    if (tc->nb_sheets > 1 && av_get_frame_filename(fname, sizeof(fname), oopt->fname, 0) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%d sprite sheets need a %%d pattern in the output name\n", tc->nb_sheets);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    // 2
+    if ((ret = open_encoder(tc, oopt->fname)) < 0 || (ret = alloc_sheets(tc)) < 0) {
+        goto end;
+    }
+    ret = 0;
+
+end:
+    avio_mmap_close_input(&fmt_ctx);
+    return ret;
+}
+
+// 各时间点按顺序均分给工作线程，线程数不超过核预算和缩略图个数
+static int run_workers(thumb_ctx_t *tc) {
+    int nb_cores = tc->opt->nb_cores > 0 ? tc->opt->nb_cores : av_cpu_count();
+    int ret = 0;
+
+    tc->nb_workers = av_clip(FFMIN(nb_cores, tc->nb_thumbs), 1, MAX_THUMB_WORKERS);
+    for (int k = 0; k < tc->nb_workers; k++) {
+        thumb_worker_t *w = &tc->workers[k];
+        w->tc = tc;
+        w->first = tc->nb_thumbs * k / tc->nb_workers;
+        w->last = tc->nb_thumbs * (k + 1) / tc->nb_workers;
+        w->tid = SDL_CreateThread(worker_thread, "thumb_worker", w);
+        if (!w->tid) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+            w->ret = AVERROR(ENOMEM);
+        }
+    }
+    for (int k = 0; k < tc->nb_workers; k++) {
+        SDL_WaitThread(tc->workers[k].tid, NULL);
+        if (ret == 0) {
+            ret = tc->workers[k].ret;
+        }
+    }
+
+    return ret;
+}
+
+// 编码各拼图并写入文件。图片编码器只做帧内编码，送入一帧即输出一个packet
+static int write_sheets(thumb_ctx_t *tc) {
+    const char *pattern = tc->opt->outputs[0].fname;
+    AVPacket *pkt = av_packet_alloc();
+    char fname[1024];
+    int ret = 0;
+
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+    for (int s = 0; s < tc->nb_sheets && ret >= 0; s++) {
+        AVIOContext *pb = NULL;
+        if (tc->nb_sheets > 1) {
+            av_get_frame_filename(fname, sizeof(fname), pattern, s);
+        } else {
+            av_strlcpy(fname, pattern, sizeof(fname));
+        }
+        if ((ret = av_encode_frame(tc->enc_ctx, tc->sheets[s], pkt)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot encode sprite sheet %s\n", fname);
+            break;
+        }
+        if ((ret = avio_open(&pb, fname, AVIO_FLAG_WRITE)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'\n", fname);
+        } else {
+            avio_write(pb, pkt->data, pkt->size);
+            ret = avio_closep(&pb);
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+
+    return ret;
+}
+
+static void deinit_thumbnails(thumb_ctx_t *tc) {
+    for (int s = 0; tc->sheets && s < tc->nb_sheets; s++) {
+        av_frame_free(&tc->sheets[s]);
+    }
+    av_free(tc->sheets);
+    avcodec_free_context(&tc->enc_ctx);
+}
+
+int transcode_thumbnails(const transcode_opt_t *opt) {
+    thumb_ctx_t tc;
+    int64_t t0 = av_gettime_relative();
+    int nb_decoded = 0;
+    int64_t decode_us = 0;
+    int ret;
+
+    memset(&tc, 0, sizeof(tc));
+    tc.opt = opt;
+    if (opt->nb_outputs != 1 || opt->nb_thumbs <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "Thumbnails need exactly one output\n");
+        return AVERROR(EINVAL);
+    }
+
+    if ((ret = init_thumbnails(&tc)) < 0 || (ret = run_workers(&tc)) < 0 ||
+        (ret = write_sheets(&tc)) < 0) {
+        goto end;
+    }
+
+    for (int k = 0; k < tc.nb_workers; k++) {
+        nb_decoded += tc.workers[k].nb_decoded;
+        decode_us += tc.workers[k].decode_us;
+    }
+    av_log(NULL, AV_LOG_INFO, "Thumbnails: %d thumbnails of %dx%d from %d decoded keyframes (%.2f ms each), "
+           "%d sprite sheet(s) of %dx%d, %d workers, %.1f ms\n", tc.nb_thumbs, tc.width, tc.height,
+           nb_decoded, decode_us / 1000.0 / tc.nb_thumbs, tc.nb_sheets, tc.cols, tc.rows, tc.nb_workers,
+           (av_gettime_relative() - t0) / 1000.0);
+
+end:
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Thumbnails failed: %s\n", av_err2str(ret));
+    }
+    deinit_thumbnails(&tc);
+
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef __THUMBNAIL_H__
+#define __THUMBNAIL_H__
+
+#include "transcode.h"
+
+// 缩略图的默认宽度(高度按输入宽高比计算)和拼图每行的默认缩略图个数
+#define THUMB_DEFAULT_WIDTH 160
+#define THUMB_DEFAULT_COLS  10
+// 并行取缩略图的最大线程数
+#define MAX_THUMB_WORKERS   16
+
+// 缩略图拼图(sprite sheet)：在输入的[opt->trim_start, opt->trim_end]区间(默认整个输入)内均匀取
+// opt->nb_thumbs个时间点，每个时间点只解码其之前最近的关键帧，缩放为opt->outputs[0]指定的尺寸后
+// 按opt->thumb_cols列、opt->thumb_rows行拼成图片，按输出文件扩展名编码为JPEG或PNG
+// 缩略图多于一张拼图的容量时输出多张拼图，输出文件名须含%d，如"sprite%03d.jpg"。opt->nb_thumbs为1时即封面图
+int transcode_thumbnails(const transcode_opt_t *opt);
+
+#endif
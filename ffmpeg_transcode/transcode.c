@@ -0,0 +1,1700 @@
+/**
+ * @file
+ * Pipelined transcoder: demux, decode, filter, encode and mux run on
+ * separate threads connected by bounded queues.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avstring.h>
+#include <libavutil/time.h>
+#include "av_codec.h"
+#include "report.h"
+#include "transcode.h"
+
+// 断点续转要求输出文件截断后可以直接续写，只支持MPEG-TS，且只有一个输出
+static bool can_checkpoint(const transcode_opt_t *opt) {
+    AVOutputFormat *ofmt = av_guess_format(NULL, opt->outputs[0].fname, NULL);
+
+    if (opt->nb_outputs != 1 || opt->nb_chunks > 1 || !ofmt || strcmp(ofmt->name, "mpegts") != 0) {
+        av_log(NULL, AV_LOG_ERROR, "Checkpoints require a single MPEG-TS output without chunks\n");
+        return false;
+    }
+    return true;
+}
+
+// 编码器名为"copy"的音视频流直接复制码流
+static bool is_stream_copy(const transcode_opt_t *opt, enum AVMediaType type) {
+    return (type == AVMEDIA_TYPE_VIDEO && strcmp(opt->v_enc_name, "copy") == 0) ||
+           (type == AVMEDIA_TYPE_AUDIO && strcmp(opt->a_enc_name, "copy") == 0);
+}
+
+// 未被-map选中的输入流没有解码器、滤镜图、编码器和输出流，见open_input_file()
+static bool is_mapped(const transcode_ctx_t *tc, int stream_idx) {
+    return tc->ictx.codec_ctx[stream_idx] != NULL;
+}
+
+// 解码帧的格式与各输出编码器的输入格式完全相同，且用户未指定滤镜时，无需经过滤镜图
+static bool can_bypass_filters(const transcode_ctx_t *tc, int stream_idx) {
+    const AVCodecContext *dec_ctx = tc->ictx.codec_ctx[stream_idx];
+
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO && tc->opt->v_filters) {
+        return false;
+    } else if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && tc->opt->a_filters) {
+        return false;
+    }
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        const AVCodecContext *enc_ctx = tc->outputs[k].octx.codec_ctx[stream_idx];
+        if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (enc_ctx->width != dec_ctx->width || enc_ctx->height != dec_ctx->height ||
+                enc_ctx->pix_fmt != dec_ctx->pix_fmt) {
+                return false;
+            }
+        } else {
+            uint64_t dec_layout = dec_ctx->channel_layout ? dec_ctx->channel_layout :
+                                  av_get_default_channel_layout(dec_ctx->channels);
+            if (enc_ctx->sample_fmt != dec_ctx->sample_fmt || enc_ctx->sample_rate != dec_ctx->sample_rate ||
+                enc_ctx->channel_layout != dec_layout) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// -vf可能改变图像尺寸(如crop、transpose、pad)，未指定-s的输出按用户滤镜的输出尺寸编码
+// 编码器在滤镜图之前打开，因此先单独配置一次用户滤镜得到该尺寸。各输出的尺寸对所有视频流相同，
+// 有多路转码的视频流时以第一路为准
+static int probe_filtered_size(transcode_ctx_t *tc) {
+    AVFormatContext *fmt_ctx = tc->ictx.fmt_ctx;
+    filter_ivfmt_t ivfmt;
+    int width, height;
+    int ret;
+
+    if (is_stream_copy(tc->opt, AVMEDIA_TYPE_VIDEO)) {
+        return 0;
+    }
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if (!is_mapped(tc, i) || fmt_ctx->streams[i]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+            continue;
+        }
+        get_filter_ivfmt(&tc->ictx, i, &ivfmt);
+        if ((ret = probe_video_filters(tc->opt->v_filters, &ivfmt, &width, &height)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot configure video filters '%s'\n", tc->opt->v_filters);
+            return ret;
+        }
+        for (int k = 0; k < tc->opt->nb_outputs; k++) {
+            if (tc->oopts[k].width <= 0) {
+                tc->oopts[k].width = width;
+                tc->oopts[k].height = height;
+            }
+        }
+        break;
+    }
+
+    return 0;
+}
+
+// 为每个音频流/视频流建立一个滤镜图，滤镜图的输出个数与输出文件个数相同
+// 用户通过-vf/-af指定的滤镜位于滤镜图的最前面，作用于每路视频流/音频流
+// 只有一个输出且无需缩放时使用空滤镜，滤镜图中将buffer滤镜和buffersink滤镜直接相连
+// 目的是：通过视频buffersink滤镜将视频流输出像素格式转换为编码器采用的像素格式
+//         通过音频abuffersink滤镜将音频流输出声道布局转换为编码器采用的声道布局
+//         为下一步的编码操作作好准备
+// 有多个输出时，视频经split滤镜复制为多路，指定了-s的输出再经scale滤镜缩放为该尺寸；
+// 音频经asplit滤镜复制为多路。解码只进行一次，解码帧在滤镜图内部以引用计数方式共享
+// 若无需任何处理(见can_bypass_filters())，则不建立滤镜图，解码帧直接送往编码器，filter_graph为NULL
+static int init_filters(transcode_ctx_t *tc) {
+    int nb_streams = tc->nb_streams;
+    int nb_outputs = tc->nb_outputs;
+    filter_ctx_t *p_fctxs = av_mallocz_array(nb_streams, sizeof(*p_fctxs));
+    if (!p_fctxs) {
+        return AVERROR(ENOMEM);
+    }
+    tc->fctxs = p_fctxs;
+
+    filter_ivfmt_t ivfmt;
+    filter_ovfmt_t ovfmts[MAX_OUTPUTS];
+    filter_iafmt_t iafmt;
+    filter_oafmt_t oafmts[MAX_OUTPUTS];
+    enum AVPixelFormat pix_fmts[MAX_OUTPUTS][2];
+    enum AVSampleFormat sample_fmts[MAX_OUTPUTS][2];
+    int sample_rates[MAX_OUTPUTS][2];
+    uint64_t channel_layouts[MAX_OUTPUTS][2];
+    char descr[1024];
+    enum AVMediaType codec_type;
+    for (int i = 0; i < nb_streams; i++) {
+        codec_type = tc->ictx.fmt_ctx->streams[i]->codecpar->codec_type;
+        if (!is_mapped(tc, i) || is_stream_copy(tc->opt, codec_type)) {
+            continue;
+        }
+        if ((codec_type == AVMEDIA_TYPE_VIDEO || codec_type == AVMEDIA_TYPE_AUDIO) &&
+            can_bypass_filters(tc, i)) {
+            av_log(NULL, AV_LOG_INFO, "stream #%d bypasses filters\n", i);
+            continue;
+        }
+
+        int ret = 0;
+        if (codec_type == AVMEDIA_TYPE_VIDEO) {
+            const char *user_descr = tc->opt->v_filters;
+            get_filter_ivfmt(&tc->ictx, i, &ivfmt);
+            // 送入滤镜图的帧时间戳已转换为编码器时基，见decode_packet()
+            ivfmt.time_base = tc->outputs[0].octx.codec_ctx[i]->time_base;
+            descr[0] = '\0';
+            if (user_descr) {
+                av_strlcatf(descr, sizeof(descr), "%s,", user_descr);
+            }
+            if (nb_outputs > 1) {
+                av_strlcatf(descr, sizeof(descr), "split=%d", nb_outputs);
+                for (int k = 0; k < nb_outputs; k++) {
+                    av_strlcatf(descr, sizeof(descr), "[s%d]", k);
+                }
+                av_strlcat(descr, ";", sizeof(descr));
+            }
+            for (int k = 0; k < nb_outputs; k++) {
+                AVCodecContext *enc_ctx = tc->outputs[k].octx.codec_ctx[i];
+                pix_fmts[k][0] = enc_ctx->pix_fmt;
+                pix_fmts[k][1] = AV_PIX_FMT_NONE;
+                ovfmts[k].pix_fmts = pix_fmts[k];
+                if (nb_outputs > 1) {
+                    av_strlcatf(descr, sizeof(descr), "[s%d]", k);
+                }
+                // 只有指定了-s的输出才缩放，否则编码器尺寸即用户滤镜的输出尺寸，见probe_filtered_size()
+                if (tc->opt->outputs[k].width > 0) {
+                    av_strlcatf(descr, sizeof(descr), "scale=%d:%d", enc_ctx->width, enc_ctx->height);
+                } else {
+                    av_strlcat(descr, "null", sizeof(descr));
+                }
+                if (nb_outputs > 1) {
+                    av_strlcatf(descr, sizeof(descr), "[out%d]%s", k, k < nb_outputs - 1 ? ";" : "");
+                }
+            }
+            av_log(NULL, AV_LOG_INFO, "stream #%d video filters: %s\n", i, descr);
+            ret = init_video_filters(descr, &ivfmt, ovfmts, nb_outputs, tc->threads.v_filter_threads, &p_fctxs[i]);
+        } else if (codec_type == AVMEDIA_TYPE_AUDIO) {
+            const char *user_descr = tc->opt->a_filters;
+            get_filter_iafmt(&tc->ictx, i, &iafmt);
+            iafmt.time_base = tc->outputs[0].octx.codec_ctx[i]->time_base;
+            descr[0] = '\0';
+            if (user_descr) {
+                av_strlcatf(descr, sizeof(descr), "%s,", user_descr);
+            }
+            if (nb_outputs > 1) {
+                av_strlcatf(descr, sizeof(descr), "asplit=%d", nb_outputs);
+                for (int k = 0; k < nb_outputs; k++) {
+                    av_strlcatf(descr, sizeof(descr), "[out%d]", k);
+                }
+            } else {
+                av_strlcat(descr, "anull", sizeof(descr));
+            }
+            for (int k = 0; k < nb_outputs; k++) {
+                AVCodecContext *enc_ctx = tc->outputs[k].octx.codec_ctx[i];
+                sample_fmts[k][0] = enc_ctx->sample_fmt;
+                sample_fmts[k][1] = -1;
+                sample_rates[k][0] = enc_ctx->sample_rate;
+                sample_rates[k][1] = -1;
+                channel_layouts[k][0] = enc_ctx->channel_layout;
+                channel_layouts[k][1] = -1;
+                oafmts[k].sample_fmts = sample_fmts[k];
+                oafmts[k].sample_rates = sample_rates[k];
+                oafmts[k].channel_layouts = channel_layouts[k];
+            }
+            av_log(NULL, AV_LOG_INFO, "stream #%d audio filters: %s\n", i, descr);
+            ret = init_audio_filters(descr, &iafmt, oafmts, nb_outputs, tc->threads.a_filter_threads, &p_fctxs[i]);
+        }
+
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// 从环形缓冲区中读取一帧数据到output_frame，output_frame在各次调用之间复用
+// 如果缓冲区中可读数据多于编码器帧大小，则只读取编码器帧大小的数据出来，否则将缓冲区中数据读完
+static int read_frame_from_audio_fifo(av_audio_ring_t *ring,
+                                      AVCodecContext *occtx,
+                                      AVFrame *output_frame) {
+    const int frame_size = FFMIN(av_audio_ring_size(ring), occtx->frame_size);
+    int ret;
+
+    // 释放上一帧的缓冲区引用，编码器不再使用后缓冲区回到环形缓冲区的缓冲池
+    av_frame_unref(output_frame);
+    output_frame->channel_layout = occtx->channel_layout;
+    output_frame->channels       = occtx->channels;
+    output_frame->format         = occtx->sample_fmt;
+    output_frame->sample_rate    = occtx->sample_rate;
+
+    if ((ret = av_audio_ring_read(ring, output_frame, frame_size)) < 0) {
+        fprintf(stderr, "Could not read data from FIFO\n");
+        return ret;
+    }
+
+    return frame_size;
+}
+
+static void free_packet_item(void *item) {
+    AVPacket *pkt = item;
+    av_packet_free(&pkt);
+}
+
+static void free_frame_item(void *item) {
+    AVFrame *frame = item;
+    av_frame_free(&frame);
+}
+
+static bool is_transcoded(const stream_ctx_t *sctx) {
+    return sctx->i_codec_ctx != NULL && !sctx->discard;
+}
+
+// 音视频流数据连续，复用时需等待其packet到达以保证交织顺序；字幕等流数据稀疏，不等待
+static bool is_dense(const stream_ctx_t *sctx) {
+    enum AVMediaType type = sctx->i_stream->codecpar->codec_type;
+    return (type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO) && !sctx->discard;
+}
+
+// 任一阶段出错时记录错误码并中止所有队列，其他阶段随之退出
+static void abort_pipeline(transcode_ctx_t *tc, int err) {
+    SDL_LockMutex(tc->err_mutex);
+    if (tc->err == 0) {
+        tc->err = err;
+    }
+    SDL_UnlockMutex(tc->err_mutex);
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        stream_ctx_t *sctx = &tc->sctxs[i];
+        if (is_transcoded(sctx)) {
+            av_queue_abort(&sctx->dec_queue);
+            if (sctx->flt_ctx) {
+                av_queue_abort(&sctx->flt_queue);
+            }
+        }
+        for (int k = 0; k < tc->nb_outputs; k++) {
+            ostream_ctx_t *ost = &tc->outputs[k].osts[i];
+            av_queue_abort(&ost->mux_queue);
+            if (is_transcoded(sctx)) {
+                av_queue_abort(&ost->enc_queue);
+            }
+        }
+    }
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        SDL_SemPost(tc->outputs[k].mux_sem);
+    }
+}
+
+// 向复用阶段输出一个packet，并唤醒复用线程
+static int put_mux_packet(ostream_ctx_t *ost, AVPacket *pkt) {
+    int64_t t0 = av_gettime_relative();
+    int ret = av_queue_put(&ost->mux_queue, pkt);
+    stage_stat_add(&ost->mux_wait_stat, av_gettime_relative() - t0);
+    if (ret == 0) {
+        SDL_SemPost(ost->of->mux_sem);
+    }
+    return ret;
+}
+
+static void finish_mux_queue(ostream_ctx_t *ost) {
+    av_queue_finish(&ost->mux_queue);
+    SDL_SemPost(ost->of->mux_sem);
+}
+
+
+// 分块转码时，chunk_stream流的dts(无dts时用pts)到达下一块的起始pts即结束。按dts判断：开放GOP中下一块起始关键帧之后的
+// 前导B帧显示时间在本块内，解码顺序在关键帧之后但dts不大于pts，仍会被读入本块解码；pts不小于chunk_end的帧解码后由end_pts丢弃
+static bool reach_chunk_end(const transcode_opt_t *opt, const AVPacket *pkt) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    return opt->chunk_end != AV_NOPTS_VALUE &&
+           pkt->stream_index == opt->chunk_stream &&
+           ts != AV_NOPTS_VALUE && ts >= opt->chunk_end;
+}
+
+// -t/-to：流的packet越过截取终点即结束此流。按dts判断，显示时间在终点之前的B帧解码顺序也在终点之前，不会被截掉
+static bool reach_trim_end(const stream_ctx_t *sctx, const AVPacket *pkt) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    return sctx->end_dts != AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE && ts >= sctx->end_dts;
+}
+
+// 音视频流是否都已结束。截取终点之后字幕等稀疏流可能再也没有packet，不必等它们读到文件末尾
+static bool dense_streams_ended(const transcode_ctx_t *tc) {
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if (is_dense(&tc->sctxs[i]) && !tc->sctxs[i].eof) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 相对输入起点的时间(AV_TIME_BASE)转换为输入文件中的绝对时间
+static int64_t input_ts(const AVFormatContext *fmt_ctx, int64_t ts) {
+    return fmt_ctx->start_time != AV_NOPTS_VALUE ? ts + fmt_ctx->start_time : ts;
+}
+
+// 直接复用的packet送往每个输出文件，除最后一个输出外，其他输出使用packet的新引用
+// pkt时间戳的单位是tb
+static int put_copy_packet(stream_ctx_t *sctx, AVPacket *pkt, AVRational tb) {
+    transcode_ctx_t *tc = sctx->tc;
+    int ret;
+
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        ostream_ctx_t *ost = &tc->outputs[k].osts[sctx->stream_idx];
+        AVPacket *opkt = pkt;
+        if (k < tc->nb_outputs - 1) {
+            opkt = av_pool_get(&tc->pkt_pool);
+            if (!opkt) {
+                av_pool_put(&tc->pkt_pool, pkt);
+                return AVERROR(ENOMEM);
+            }
+            if ((ret = av_packet_ref(opkt, pkt)) < 0) {
+                av_pool_put(&tc->pkt_pool, opkt);
+                av_pool_put(&tc->pkt_pool, pkt);
+                return ret;
+            }
+        }
+        // AVPacket.pts和AVPacket.dts的单位是AVStream.time_base，不同的封装格式其AVStream.time_base不同
+        // 所以输出文件中，每个packet需要根据输出封装格式重新计算pts和dts
+        opkt->stream_index = ost->o_stream->index;
+        av_packet_rescale_ts(opkt, tb, ost->o_stream->time_base);
+        ret = put_mux_packet(ost, opkt);
+        if (ret < 0) {
+            av_pool_put(&tc->pkt_pool, opkt);
+            if (opkt != pkt) {
+                av_pool_put(&tc->pkt_pool, pkt);
+            }
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// 直接复用一个packet，有码流滤镜时先经过码流滤镜。pkt为NULL表示冲洗码流滤镜
+static int copy_packet(stream_ctx_t *sctx, AVPacket *pkt) {
+    av_pool_t *pool = &sctx->tc->pkt_pool;
+    int ret;
+
+    if (!sctx->bsf_ctx) {
+        return pkt ? put_copy_packet(sctx, pkt, sctx->i_stream->time_base) : 0;
+    }
+
+    // av_bsf_send_packet()取走pkt中的数据引用，pkt成为空packet
+    ret = av_bsf_send_packet(sctx->bsf_ctx, pkt);
+    av_pool_put(pool, pkt);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "bitstream filter of stream #%d error %d\n", sctx->stream_idx, ret);
+        return ret;
+    }
+
+    while (1) {
+        AVPacket *opkt = av_pool_get(pool);
+        if (!opkt) {
+            return AVERROR(ENOMEM);
+        }
+        ret = av_bsf_receive_packet(sctx->bsf_ctx, opkt);
+        if (ret < 0) {
+            av_pool_put(pool, opkt);
+            break;
+        }
+        ret = put_copy_packet(sctx, opkt, sctx->bsf_ctx->time_base_out);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        return 0;
+    }
+    av_log(NULL, AV_LOG_ERROR, "bitstream filter of stream #%d error %d\n", sctx->stream_idx, ret);
+    return ret;
+}
+
+// 解复用阶段结束一路流：转码的流通知其解码线程冲洗解码器，直接复用的流冲洗码流滤镜后结束其在各输出中的复用队列
+static int end_stream(stream_ctx_t *sctx) {
+    transcode_ctx_t *tc = sctx->tc;
+    int ret = 0;
+
+    if (sctx->eof) {
+        return 0;
+    }
+    sctx->eof = true;
+    sctx->i_stream->discard = AVDISCARD_ALL;    // 此流后续的packet在解复用器中即被丢弃
+    if (is_transcoded(sctx)) {
+        av_queue_finish(&sctx->dec_queue);
+    } else {
+        if (!sctx->discard) {
+            ret = copy_packet(sctx, NULL);
+        }
+        for (int k = 0; k < tc->nb_outputs; k++) {
+            finish_mux_queue(&tc->outputs[k].osts[sctx->stream_idx]);
+        }
+    }
+
+    return ret;
+}
+
+// 1. 解复用线程：从输入文件读取packet，音视频packet送入各流的解码队列，其他packet(字幕等)直接送入复用队列
+static int demux_thread(void *arg) {
+    transcode_ctx_t *tc = arg;
+    AVFormatContext *ifmt_ctx = tc->ictx.fmt_ctx;
+    AVPacket *pkt = NULL;
+    int nb_active = 0;
+    int ret = 0;
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if (!tc->sctxs[i].eof) {
+            nb_active++;
+        }
+    }
+
+    while (nb_active > 0) {
+        pkt = av_pool_get(&tc->pkt_pool);
+        if (!pkt) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+
+        int64_t t0 = av_gettime_relative();
+        ret = av_read_frame(ifmt_ctx, pkt);
+        if (ret < 0) {
+            av_pool_put(&tc->pkt_pool, pkt);
+            if ((ret == AVERROR_EOF) || avio_feof(ifmt_ctx->pb)) {
+                av_log(NULL, AV_LOG_INFO, "av_read_frame() end of file\n");
+                ret = 0;
+                break;
+            }
+            goto end;
+        }
+
+        stream_ctx_t *sctx = &tc->sctxs[pkt->stream_index];
+        stage_stat_add(&sctx->demux_stat, av_gettime_relative() - t0);
+        av_log(NULL, AV_LOG_DEBUG, "Demuxer gave frame of stream_index %u\n", pkt->stream_index);
+
+        if (sctx->eof) {
+            av_pool_put(&tc->pkt_pool, pkt);
+            continue;
+        }
+        if (reach_chunk_end(tc->opt, pkt)) {
+            av_pool_put(&tc->pkt_pool, pkt);
+            nb_active--;
+            if ((ret = end_stream(sctx)) < 0) {
+                goto end;
+            }
+            continue;
+        }
+        if (reach_trim_end(sctx, pkt)) {
+            av_pool_put(&tc->pkt_pool, pkt);
+            nb_active--;
+            if ((ret = end_stream(sctx)) < 0) {
+                goto end;
+            }
+            if (dense_streams_ended(tc)) {
+                // 截取区间已读完，其余流在循环后一并结束
+                break;
+            }
+            continue;
+        }
+
+        if (!is_transcoded(sctx) && sctx->resume_dts != AV_NOPTS_VALUE &&
+            pkt->dts != AV_NOPTS_VALUE && pkt->dts <= sctx->resume_dts) {
+            // 续转时已写入输出文件的部分
+            av_pool_put(&tc->pkt_pool, pkt);
+            continue;
+        }
+
+        if (sctx->ts_offset != 0) {
+            // -ss：时间戳以截取起点为0，起点之前的帧为负值
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                pkt->pts -= sctx->ts_offset;
+            }
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                pkt->dts -= sctx->ts_offset;
+            }
+            // 直接复用的视频流须从关键帧开始保留，其他直接复用的流丢弃整个位于起点之前的packet
+            if (!is_transcoded(sctx) && sctx->i_stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+                pkt->pts != AV_NOPTS_VALUE && pkt->pts + pkt->duration <= 0) {
+                av_pool_put(&tc->pkt_pool, pkt);
+                continue;
+            }
+        }
+
+        if (is_transcoded(sctx)) {
+            ret = av_queue_put(&sctx->dec_queue, pkt);
+            if (ret < 0) {
+                av_pool_put(&tc->pkt_pool, pkt);
+            }
+        } else {
+            ret = copy_packet(sctx, pkt);
+        }
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    // 输入文件已读完，通知各路流冲洗(flush)解码器
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if ((ret = end_stream(&tc->sctxs[i])) < 0) {
+            goto end;
+        }
+    }
+
+end:
+    if (ret < 0) {
+        abort_pipeline(tc, ret);
+    }
+    return ret;
+}
+
+// 不经过滤镜图的流：解码帧直接送入各输出的编码队列，除最后一个输出外，其余输出使用帧的新引用
+static int put_enc_frame(stream_ctx_t *sctx, AVFrame *frame) {
+    transcode_ctx_t *tc = sctx->tc;
+    int ret;
+
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        ostream_ctx_t *ost = &tc->outputs[k].osts[sctx->stream_idx];
+        AVFrame *frame_ref = frame;
+        if (k < tc->nb_outputs - 1) {
+            frame_ref = av_pool_get(&tc->frm_pool);
+            if (!frame_ref) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            if ((ret = av_frame_ref(frame_ref, frame)) < 0) {
+                av_pool_put(&tc->frm_pool, frame_ref);
+                goto fail;
+            }
+        }
+        if ((ret = av_queue_put(&ost->enc_queue, frame_ref)) < 0) {
+            av_pool_put(&tc->frm_pool, frame_ref);
+            if (frame_ref == frame) {
+                return ret;
+            }
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    av_pool_put(&tc->frm_pool, frame);
+    return ret;
+}
+
+// 解码得到的frame送入滤镜队列，不经过滤镜图的流直接送入编码队列。失败时frame已被回收
+static int put_decoded_frame(stream_ctx_t *sctx, AVFrame *frame) {
+    int ret;
+
+    if (sctx->flt_ctx) {
+        ret = av_queue_put(&sctx->flt_queue, frame);
+        if (ret < 0) {
+            av_pool_put(&sctx->tc->frm_pool, frame);
+        }
+        return ret;
+    }
+    return put_enc_frame(sctx, frame);
+}
+
+// 解码一个packet，得到的所有frame送入滤镜队列，不经过滤镜图的流直接送入编码队列。pkt为NULL表示冲洗解码器
+static int decode_packet(stream_ctx_t *sctx, AVPacket *pkt) {
+    AVPacket flush_pkt = { .data = NULL, .size = 0 };
+    bool new_packet = true;
+    int64_t us = 0;                 // 本次解码耗时，不含等待队列的时间
+    int ret;
+
+    if (pkt == NULL) {
+        pkt = &flush_pkt;
+    } else {
+        av_packet_rescale_ts(pkt, sctx->i_stream->time_base, sctx->dec_tb);
+    }
+
+    // 一个视频packet包含一个视频frame，一个音频packet可能包含多个音频frame，
+    // 冲洗解码器时一个flush packet会取出多个frame，每次循环处理一个frame
+    while (1) {
+        AVFrame *frame = av_pool_get(&sctx->tc->frm_pool);
+        if (!frame) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+
+        int64_t t0 = av_gettime_relative();
+        ret = av_decode_frame(sctx->i_codec_ctx, pkt, &new_packet, frame);
+        us += av_gettime_relative() - t0;
+        if (ret < 0) {
+            av_pool_put(&sctx->tc->frm_pool, frame);
+            break;
+        }
+        if (sctx->start_pts != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE &&
+            frame->pts < sctx->start_pts) {
+            // 起始关键帧之前的帧(如开放GOP中的前导B帧)不属于本段，丢弃；-ss时为起点之前只用于解码参考的帧
+            av_pool_put(&sctx->tc->frm_pool, frame);
+            continue;
+        }
+        if (sctx->end_pts != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE &&
+            frame->pts >= sctx->end_pts) {
+            // -t/-to：截取终点之后的帧，如冲洗解码器时取出的帧；分块转码时为下一块的帧
+            av_pool_put(&sctx->tc->frm_pool, frame);
+            continue;
+        }
+
+        sctx->nb_frames++;
+        if (sctx->dedup) {
+            t0 = av_gettime_relative();
+            ret = av_dedup_filter(sctx->dedup, frame);
+            us += av_gettime_relative() - t0;
+            if (ret != 0) {
+                // 重复帧的数据已移入dedup，或出错
+                av_pool_put(&sctx->tc->frm_pool, frame);
+                if (ret < 0) {
+                    goto end;
+                }
+                continue;
+            }
+        }
+        if ((ret = put_decoded_frame(sctx, frame)) < 0) {
+            goto end;
+        }
+    }
+
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        ret = 0;
+    } else {
+        av_log(NULL, AV_LOG_ERROR, "decode stream #%d error %d\n", sctx->stream_idx, ret);
+    }
+
+end:
+    stage_stat_add(&sctx->decode_stat, us);
+    return ret;
+}
+
+// 2. 解码线程，每路音视频流一个
+static int decode_thread(void *arg) {
+    stream_ctx_t *sctx = arg;
+    AVPacket *pkt = NULL;
+    int ret;
+
+    while (1) {
+        ret = av_queue_get(&sctx->dec_queue, (void **)&pkt, 1);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            goto end;
+        }
+
+        ret = decode_packet(sctx, pkt);
+        av_pool_put(&sctx->tc->pkt_pool, pkt);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    // 冲洗解码器，取出其中缓存的帧
+    ret = decode_packet(sctx, NULL);
+    if (ret < 0) {
+        goto end;
+    }
+    if (sctx->dedup) {
+        // 以静止画面结束时送出最后被丢弃的帧，输出时长与输入一致
+        AVFrame *frame = av_pool_get(&sctx->tc->frm_pool);
+        if (!frame) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if (av_dedup_flush(sctx->dedup, frame) == 0) {
+            av_pool_put(&sctx->tc->frm_pool, frame);
+        } else if ((ret = put_decoded_frame(sctx, frame)) < 0) {
+            goto end;
+        }
+    }
+    if (sctx->flt_ctx) {
+        av_queue_finish(&sctx->flt_queue);
+    } else {
+        for (int k = 0; k < sctx->tc->nb_outputs; k++) {
+            av_queue_finish(&sctx->tc->outputs[k].osts[sctx->stream_idx].enc_queue);
+        }
+    }
+
+end:
+    if (ret < 0) {
+        abort_pipeline(sctx->tc, ret);
+    }
+    return ret;
+}
+
+// 将一个frame送入滤镜图，滤镜图第k个输出得到的所有frame送入第k个输出文件的编码队列
+// frame为NULL表示冲洗滤镜
+static int filter_frame(stream_ctx_t *sctx, AVFrame *frame) {
+    transcode_ctx_t *tc = sctx->tc;
+    int64_t t0 = av_gettime_relative();
+    int ret = filtering_send_frame(sctx->flt_ctx, frame);
+    int64_t us = av_gettime_relative() - t0;    // 本次滤镜耗时，不含等待队列的时间
+    if (ret < 0) {
+        goto end;
+    }
+
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        ostream_ctx_t *ost = &tc->outputs[k].osts[sctx->stream_idx];
+        while (1) {
+            AVFrame *frame_flt = av_pool_get(&tc->frm_pool);
+            if (!frame_flt) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+
+            t0 = av_gettime_relative();
+            ret = filtering_receive_frame(sctx->flt_ctx, k, frame_flt);
+            us += av_gettime_relative() - t0;
+            if (ret < 0) {
+                av_pool_put(&tc->frm_pool, frame_flt);
+                break;
+            }
+            // 用户滤镜(如fps)可能改变输出时基，将时间戳转换回编码器时基
+            if (frame_flt->pts != AV_NOPTS_VALUE) {
+                frame_flt->pts = av_rescale_q(frame_flt->pts,
+                                              av_buffersink_get_time_base(sctx->flt_ctx->bufsink_ctxs[k]),
+                                              ost->o_codec_ctx->time_base);
+            }
+
+            ret = av_queue_put(&ost->enc_queue, frame_flt);
+            if (ret < 0) {
+                av_pool_put(&tc->frm_pool, frame_flt);
+                goto end;
+            }
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            goto end;
+        }
+    }
+    ret = 0;
+
+end:
+    stage_stat_add(&sctx->filter_stat, us);
+    return ret;
+}
+
+// 3. 滤镜线程，每路音视频流一个
+static int filter_thread(void *arg) {
+    stream_ctx_t *sctx = arg;
+    transcode_ctx_t *tc = sctx->tc;
+    AVFrame *frame = NULL;
+    int ret;
+
+    while (1) {
+        ret = av_queue_get(&sctx->flt_queue, (void **)&frame, 1);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            goto end;
+        }
+
+        ret = filter_frame(sctx, frame);
+        av_pool_put(&tc->frm_pool, frame);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    // 冲洗滤镜
+    ret = filter_frame(sctx, NULL);
+    if (ret < 0) {
+        goto end;
+    }
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        av_queue_finish(&tc->outputs[k].osts[sctx->stream_idx].enc_queue);
+    }
+
+end:
+    if (ret < 0) {
+        abort_pipeline(tc, ret);
+    }
+    return ret;
+}
+
+// 编码一个frame，得到的所有packet送入复用队列。frame为NULL表示冲洗编码器
+static int encode_frame(ostream_ctx_t *ost, AVFrame *frame) {
+    transcode_ctx_t *tc = ost->of->tc;
+
+    if (frame != NULL && ost->o_codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        // 将每一帧frame的帧类型设置为NONE，由编码器根据gop_size和max_b_frames参数决定帧类型
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+
+    AVPacket *pkt = av_pool_get(&tc->pkt_pool);
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+    if (frame != NULL) {
+        ost->nb_frames++;
+    }
+
+    int64_t t0 = av_gettime_relative();
+    int ret = av_encode_frame(ost->o_codec_ctx, frame, pkt);
+    int64_t us = av_gettime_relative() - t0;    // 本次编码耗时，不含等待队列的时间
+    while (ret == 0) {
+        // 更新编码帧中流序号，并进行时间基转换
+        // AVPacket.pts和AVPacket.dts的单位是AVStream.time_base，不同的封装格式其AVStream.time_base不同
+        // 所以输出文件中，每个packet需要根据输出封装格式重新计算pts和dts
+        pkt->stream_index = ost->o_stream->index;
+        av_packet_rescale_ts(pkt, ost->o_codec_ctx->time_base, ost->o_stream->time_base);
+        if (ost->drop_end != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE &&
+            pkt->pts + pkt->duration <= ost->drop_end) {
+            // 续转：这部分采样点已在断点之前写出
+            av_packet_unref(pkt);
+        } else if ((ret = put_mux_packet(ost, pkt)) < 0) {
+            break;
+        } else {
+            pkt = av_pool_get(&tc->pkt_pool);
+        }
+        if (!pkt) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        // 一个frame可能编码出多个packet(冲洗编码器时尤其如此)，全部取出
+        t0 = av_gettime_relative();
+        ret = avcodec_receive_packet(ost->o_codec_ctx, pkt);
+        us += av_gettime_relative() - t0;
+    }
+    av_pool_put(&tc->pkt_pool, pkt);
+    stage_stat_add(&ost->encode_stat, us);
+
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        return 0;
+    }
+    if (ret != AVERROR_EXIT) {
+        av_log(NULL, AV_LOG_ERROR, "encode stream #%d of output #%d error %d\n",
+               ost->ist->stream_idx, ost->of->idx, ret);
+    }
+    return ret;
+}
+
+// 使用音频环形缓冲区，从而保证每次送入编码器的音频帧尺寸满足编码器要求。frame为NULL表示冲洗
+static int encode_audio_frame_with_afifo(ostream_ctx_t *ost, AVFrame *frame) {
+    av_audio_ring_t *ring = ost->aud_fifo;
+    int enc_frame_size = ost->o_codec_ctx->frame_size;
+    int offset = 0;
+    int ret;
+
+    if (frame != NULL && ost->trim_pts != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE) {
+        // 续转：跳过断点之前已编码的采样点，从帧内的采样点开始写入，第一个读出帧的pts即trim_pts
+        if (frame->pts + frame->nb_samples <= ost->trim_pts) {
+            return 0;
+        }
+        offset = (int)FFMAX(ost->trim_pts - frame->pts, 0);
+        ost->trim_pts = AV_NOPTS_VALUE;
+    }
+
+    while (1) {
+        // 1. 将音频帧写入缓冲区，音频帧尺寸是解码格式中音频帧尺寸。缓冲区容量固定，剩余空间不足时只写入
+        //    一部分，待下面取出编码器帧腾出空间后再写入剩余部分
+        if (frame != NULL) {
+            offset += av_audio_ring_write(ring, frame, offset);
+        }
+
+        // 2. 从缓冲区中取出音频帧，音频帧尺寸是编码格式中音频帧尺寸。冲洗时将剩余数据全部取出
+        //    取出的音频帧pts由缓冲区按采样点数累加生成
+        while ((av_audio_ring_size(ring) >= enc_frame_size) ||
+               (frame == NULL && av_audio_ring_size(ring) > 0)) {
+            AVFrame *frame_enc = ost->fifo_frame;
+            ret = read_frame_from_audio_fifo(ring, ost->o_codec_ctx, frame_enc);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_INFO, "read aframe from fifo error\n");
+                return ret;
+            }
+
+            ret = encode_frame(ost, frame_enc);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        if (frame == NULL || offset >= frame->nb_samples) {
+            break;
+        }
+    }
+
+    if (frame == NULL) {
+        return encode_frame(ost, NULL);
+    }
+
+    return 0;
+}
+
+// 4. 编码线程，每个输出文件中的每路音视频流一个
+static int encode_thread(void *arg) {
+    ostream_ctx_t *ost = arg;
+    transcode_ctx_t *tc = ost->of->tc;
+    AVFrame *frame = NULL;
+    int ret;
+
+    while (1) {
+        ret = av_queue_get(&ost->enc_queue, (void **)&frame, 1);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            goto end;
+        }
+
+        if (ost->aud_fifo != NULL) {
+            ret = encode_audio_frame_with_afifo(ost, frame);
+        } else {
+            ret = encode_frame(ost, frame);
+        }
+        av_pool_put(&tc->frm_pool, frame);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    // 冲洗编码器
+    if (ost->aud_fifo != NULL) {
+        ret = encode_audio_frame_with_afifo(ost, NULL);
+    } else {
+        ret = encode_frame(ost, NULL);
+    }
+    if (ret < 0) {
+        goto end;
+    }
+    finish_mux_queue(ost);
+
+end:
+    if (ret < 0) {
+        abort_pipeline(tc, ret);
+    }
+    return ret;
+}
+
+// packet的dts(无dts时用pts)，AV_NOPTS_VALUE表示没有时间戳
+static int64_t packet_mux_ts(const AVPacket *pkt) {
+    return (pkt->dts != AV_NOPTS_VALUE) ? pkt->dts : pkt->pts;
+}
+
+// 从各路流已到达的packet中选出dts最小的一个，返回其流序号，没有packet时返回-1
+static int pick_mux_stream(output_ctx_t *of, AVPacket **heads) {
+    int best = -1;
+
+    for (int i = 0; i < of->tc->nb_streams; i++) {
+        if (heads[i] == NULL) {
+            continue;
+        }
+        int64_t ts = packet_mux_ts(heads[i]);
+        if (ts == AV_NOPTS_VALUE) {     // 没有时间戳的packet立即写出
+            return i;
+        }
+        if (best < 0 ||
+            av_compare_ts(ts, of->osts[i].o_stream->time_base,
+                          packet_mux_ts(heads[best]), of->osts[best].o_stream->time_base) < 0) {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+// 在ckpt_stream的关键帧pkt写出之前记录断点。写断点失败不影响转码
+static void write_checkpoint(output_ctx_t *of, const AVPacket *pkt) {
+    AVFormatContext *ofmt_ctx = of->octx.fmt_ctx;
+    int ret;
+
+    // 1. 冲洗复用器的交织队列和内部缓存，此前的packet全部写入文件
+    if ((ret = av_interleaved_write_frame(ofmt_ctx, NULL)) < 0 || (ret = av_write_frame(ofmt_ctx, NULL)) < 0) {
+        av_log(NULL, AV_LOG_WARNING, "Failed to flush muxer for checkpoint: %s\n", av_err2str(ret));
+        return;
+    }
+    avio_flush(ofmt_ctx->pb);
+    if (of->octx.writer && (ret = async_writer_drain(of->octx.writer)) < 0) {
+        return;
+    }
+
+    // 2. 文件当前长度即为断点位置，续转时从此关键帧开始
+    of->ckpt.out_pos = avio_tell(ofmt_ctx->pb);
+    of->ckpt.key_stream = of->ckpt_stream;
+    of->ckpt.key_pts = pkt->pts;
+    if (checkpoint_write(of->tc->opt->checkpoint_fname, &of->ckpt) == 0) {
+        av_log(NULL, AV_LOG_VERBOSE, "Checkpoint at output byte %"PRId64", pts %"PRId64"\n",
+               of->ckpt.out_pos, of->ckpt.key_pts);
+    }
+}
+
+// 5. 复用线程，每个输出文件一个：按dts顺序交织各路流输出的packet，写入输出媒体文件
+//    每路音视频流都有packet到达(或已结束)时才写出dts最小的packet，这样写出顺序即为dts顺序；
+//    若某路流的mux_queue已满(其生产者被阻塞)，则不再等待其他流，以免整条流水线相互等待而死锁。
+//    字幕等流数据稀疏，不等待其到达
+static int mux_thread(void *arg) {
+    output_ctx_t *of = arg;
+    transcode_ctx_t *tc = of->tc;
+    AVPacket **heads = av_mallocz_array(tc->nb_streams, sizeof(AVPacket *));
+    bool *finished = av_mallocz_array(tc->nb_streams, sizeof(bool));
+    int ret = 0;
+
+    if (!heads || !finished) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while (1) {
+        bool ready = true;
+        int nb_active = 0;
+        for (int i = 0; i < tc->nb_streams; i++) {
+            ostream_ctx_t *ost = &of->osts[i];
+            if (finished[i]) {
+                continue;
+            }
+            if (heads[i] == NULL) {
+                ret = av_queue_get(&ost->mux_queue, (void **)&heads[i], 0);
+                if (ret == AVERROR_EOF) {
+                    finished[i] = true;
+                    continue;
+                } else if (ret < 0) {
+                    goto end;
+                } else if (ret == 0 && is_dense(ost->ist)) {
+                    ready = false;
+                }
+            }
+            nb_active++;
+        }
+        if (nb_active == 0) {
+            break;
+        }
+
+        int idx = pick_mux_stream(of, heads);
+        if (!ready) {
+            bool blocked = false;
+            for (int i = 0; i < tc->nb_streams && !blocked; i++) {
+                blocked = (heads[i] != NULL) && av_queue_full(&of->osts[i].mux_queue);
+            }
+            if (!blocked) {
+                idx = -1;
+            }
+        }
+        if (idx < 0) {
+            // 等待任一路流输出新的packet
+            SDL_SemWait(of->mux_sem);
+            continue;
+        }
+
+        AVPacket *pkt = heads[idx];
+        heads[idx] = NULL;
+        if (idx == of->ckpt_stream && (pkt->flags & AV_PKT_FLAG_KEY) && pkt->pts != AV_NOPTS_VALUE &&
+            (of->ckpt.key_pts == AV_NOPTS_VALUE || pkt->pts >= of->ckpt.key_pts + of->ckpt_interval)) {
+            write_checkpoint(of, pkt);
+        }
+        int64_t dts = pkt->dts;
+        int64_t end_ts = pkt->dts + pkt->duration;
+        av_log(NULL, AV_LOG_DEBUG, "Muxing frame of stream_index %d to output #%d\n", pkt->stream_index, of->idx);
+        int64_t t0 = av_gettime_relative();
+        ret = av_interleaved_write_frame(of->octx.fmt_ctx, pkt);
+        stage_stat_add(&of->osts[idx].mux_stat, av_gettime_relative() - t0);
+        av_pool_put(&tc->pkt_pool, pkt);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "write frame error %d\n", ret);
+            goto end;
+        }
+        if (of->ckpt_stream >= 0 && dts != AV_NOPTS_VALUE) {
+            of->ckpt.last_dts[idx] = dts;
+            of->ckpt.end_ts[idx] = end_ts;
+        }
+    }
+
+    ret = av_write_trailer(of->octx.fmt_ctx);
+    if (ret >= 0 && of->octx.writer) {
+        // 等待异步写线程将全部数据写入文件
+        ret = async_writer_finish(of->octx.writer);
+    }
+
+end:
+    if (heads) {
+        for (int i = 0; i < tc->nb_streams; i++) {
+            av_pool_put(&tc->pkt_pool, heads[i]);
+        }
+    }
+    av_free(heads);
+    av_free(finished);
+
+    if (ret < 0) {
+        abort_pipeline(tc, ret);
+    }
+    return ret;
+}
+
+static int init_output_streams(output_ctx_t *of) {
+    transcode_ctx_t *tc = of->tc;
+    int o_idx = 0;                  // 输出流按选中的输入流的顺序排列
+    int ret;
+
+    of->osts = av_mallocz_array(tc->nb_streams, sizeof(ostream_ctx_t));
+    if (!of->osts) {
+        return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        ostream_ctx_t *ost = &of->osts[i];
+        stream_ctx_t *sctx = &tc->sctxs[i];
+
+        ost->ist = sctx;
+        ost->of = of;
+        ost->trim_pts = AV_NOPTS_VALUE;
+        ost->drop_end = AV_NOPTS_VALUE;
+        ost->o_stream = is_mapped(tc, i) ? of->octx.fmt_ctx->streams[o_idx++] : NULL;
+        if ((ret = av_queue_init(&ost->mux_queue, PKT_QUEUE_SIZE)) < 0) {
+            return ret;
+        }
+        if (!is_transcoded(sctx)) {
+            continue;
+        }
+
+        ost->o_codec_ctx = of->octx.codec_ctx[i];
+        // AVCodecContext.frame_size表示音频帧中每个声道包含的采样点数。
+        // 如果编码器不支持可变尺寸音频帧(第一个判断条件生效)，而原始音频帧的尺寸又和编码器帧尺寸不一样(第二个判
+        // 断条件生效)，则需要引入音频帧FIFO，以保证每次从FIFO中取出的音频帧尺寸和编码器帧尺寸一样。音频FIFO输出
+        // 的音频帧不含时间戳信息，因此需要重新生成时间戳
+        if (ost->o_codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO &&
+            ((ost->o_codec_ctx->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) == 0) &&
+            (sctx->i_codec_ctx->frame_size != ost->o_codec_ctx->frame_size) && of->oafifo[i]) {
+            ost->aud_fifo = of->oafifo[i];
+            ost->fifo_frame = av_frame_alloc();
+            if (!ost->fifo_frame) {
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        if ((ret = av_queue_init(&ost->enc_queue, FRM_QUEUE_SIZE)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// 为直接复制的音视频流创建码流滤镜
+static int init_bsfs(transcode_ctx_t *tc) {
+    AVFormatContext *ifmt_ctx = tc->ictx.fmt_ctx;
+    int ret;
+
+    tc->ictx.bsf_ctx = av_mallocz_array(tc->nb_streams, sizeof(AVBSFContext *));
+    if (!tc->ictx.bsf_ctx) {
+        return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        AVStream *st = ifmt_ctx->streams[i];
+        enum AVMediaType type = st->codecpar->codec_type;
+        const char *name = NULL;
+        if (!is_mapped(tc, i) || !is_stream_copy(tc->opt, type)) {
+            continue;
+        }
+        name = (type == AVMEDIA_TYPE_VIDEO) ? tc->opt->v_bsf_name : tc->opt->a_bsf_name;
+        if (!name) {
+            continue;
+        }
+
+        const AVBitStreamFilter *filter = av_bsf_get_by_name(name);
+        if (!filter) {
+            av_log(NULL, AV_LOG_ERROR, "Unknown bitstream filter %s\n", name);
+            return AVERROR_BSF_NOT_FOUND;
+        }
+        if ((ret = av_bsf_alloc(filter, &tc->ictx.bsf_ctx[i])) < 0) {
+            return ret;
+        }
+        AVBSFContext *bsf_ctx = tc->ictx.bsf_ctx[i];
+        if ((ret = avcodec_parameters_copy(bsf_ctx->par_in, st->codecpar)) < 0) {
+            return ret;
+        }
+        bsf_ctx->time_base_in = st->time_base;
+        if ((ret = av_bsf_init(bsf_ctx)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to init bitstream filter %s for stream #%d\n", name, i);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int init_streams(transcode_ctx_t *tc) {
+    int ret;
+
+    tc->sctxs = av_mallocz_array(tc->nb_streams, sizeof(stream_ctx_t));
+    if (!tc->sctxs) {
+        return AVERROR(ENOMEM);
+    }
+
+    // 对象池容量按各队列容量之和估算，足以容纳流水线中同时存在的所有frame/packet
+    int nb_queues = tc->nb_streams * (1 + tc->nb_outputs);
+    if ((ret = av_pool_init_packet(&tc->pkt_pool, nb_queues * (PKT_QUEUE_SIZE + POOL_EXTRA_SIZE))) < 0 ||
+        (ret = av_pool_init_frame(&tc->frm_pool, nb_queues * (FRM_QUEUE_SIZE + POOL_EXTRA_SIZE))) < 0) {
+        return ret;
+    }
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        stream_ctx_t *sctx = &tc->sctxs[i];
+        enum AVMediaType codec_type = tc->ictx.fmt_ctx->streams[i]->codecpar->codec_type;
+
+        sctx->tc = tc;
+        sctx->i_fmt_ctx = tc->ictx.fmt_ctx;
+        sctx->i_stream = tc->ictx.fmt_ctx->streams[i];
+        sctx->stream_idx = i;
+        sctx->start_pts = AV_NOPTS_VALUE;
+        sctx->resume_dts = AV_NOPTS_VALUE;
+        sctx->end_dts = AV_NOPTS_VALUE;
+        sctx->end_pts = AV_NOPTS_VALUE;
+        if (!is_mapped(tc, i)) {
+            // 未选中的流：解复用器中即被丢弃，输出文件中没有此流
+            sctx->discard = true;
+            continue;
+        }
+        if (tc->opt->chunk_only && i != tc->opt->chunk_stream) {
+            // 不处理的流：输出文件中保留此流，但不写入任何数据
+            sctx->discard = true;
+            continue;
+        }
+        sctx->bsf_ctx = tc->ictx.bsf_ctx[i];
+        if (tc->opt->trim_start != AV_NOPTS_VALUE) {
+            sctx->ts_offset = av_rescale_q(input_ts(sctx->i_fmt_ctx, tc->opt->trim_start),
+                                           AV_TIME_BASE_Q, sctx->i_stream->time_base);
+        }
+        if (tc->opt->trim_end != AV_NOPTS_VALUE) {
+            sctx->end_dts = av_rescale_q(input_ts(sctx->i_fmt_ctx, tc->opt->trim_end),
+                                         AV_TIME_BASE_Q, sctx->i_stream->time_base);
+        }
+        if ((codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO) ||
+            is_stream_copy(tc->opt, codec_type)) {
+            continue;
+        }
+
+        sctx->i_codec_ctx = tc->ictx.codec_ctx[i];
+        // 不经过滤镜图的流没有滤镜线程和滤镜队列
+        sctx->flt_ctx = tc->fctxs[i].filter_graph ? &tc->fctxs[i] : NULL;
+        // 各输出的编码器时基都由解码器参数得到，彼此相同
+        sctx->dec_tb = tc->outputs[0].octx.codec_ctx[i]->time_base;
+        if (tc->opt->dedup && codec_type == AVMEDIA_TYPE_VIDEO && !(sctx->dedup = av_dedup_alloc())) {
+            return AVERROR(ENOMEM);
+        }
+        if (i == tc->opt->chunk_stream && tc->opt->chunk_start != AV_NOPTS_VALUE) {
+            // 与解码前对packet时间戳的转换方式一致，保证起始关键帧本身不会被丢弃
+            sctx->start_pts = av_rescale_q(tc->opt->chunk_start, sctx->i_stream->time_base, sctx->dec_tb);
+        }
+        if (tc->opt->trim_start != AV_NOPTS_VALUE) {
+            // 时间戳已减去ts_offset，截取起点即0
+            sctx->start_pts = 0;
+        }
+        if (sctx->end_dts != AV_NOPTS_VALUE) {
+            sctx->end_pts = av_rescale_q(sctx->end_dts - sctx->ts_offset, sctx->i_stream->time_base, sctx->dec_tb);
+        }
+        if (i == tc->opt->chunk_stream && tc->opt->chunk_end != AV_NOPTS_VALUE) {
+            // 下一块的起始关键帧及其后的帧属于下一块
+            int64_t chunk_end_pts = av_rescale_q(tc->opt->chunk_end, sctx->i_stream->time_base, sctx->dec_tb);
+            sctx->end_pts = sctx->end_pts == AV_NOPTS_VALUE ? chunk_end_pts : FFMIN(sctx->end_pts, chunk_end_pts);
+        }
+
+        if ((ret = av_queue_init(&sctx->dec_queue, PKT_QUEUE_SIZE)) < 0) {
+            return ret;
+        }
+        if (sctx->flt_ctx && (ret = av_queue_init(&sctx->flt_queue, FRM_QUEUE_SIZE)) < 0) {
+            return ret;
+        }
+    }
+
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        if ((ret = init_output_streams(&tc->outputs[k])) < 0) {
+            return ret;
+        }
+    }
+
+    // 不处理的流直接结束其复用队列
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if (tc->sctxs[i].discard) {
+            end_stream(&tc->sctxs[i]);
+        }
+    }
+
+    return 0;
+}
+
+// 读取断点文件，返回1表示从断点续转，0表示从头转码
+// 断点文件无效或与输入不符时从头转码，此后写出的断点覆盖原文件
+static int load_checkpoint(transcode_ctx_t *tc) {
+    checkpoint_t *ckpt = &tc->outputs[0].ckpt;
+    int ret;
+
+    ret = checkpoint_read(tc->opt->checkpoint_fname, ckpt);
+    if (ret == AVERROR(ENOENT)) {
+        return 0;
+    } else if (ret < 0 || ckpt->nb_streams != tc->nb_streams) {
+        av_log(NULL, AV_LOG_WARNING, "Ignoring checkpoint '%s', starting over\n", tc->opt->checkpoint_fname);
+        checkpoint_free(ckpt);
+        return 0;
+    }
+
+    tc->oopts[0].append_pos = ckpt->out_pos;
+    av_log(NULL, AV_LOG_INFO, "Resuming from checkpoint '%s': output byte %"PRId64", stream #%d pts %"PRId64"\n",
+           tc->opt->checkpoint_fname, ckpt->out_pos, ckpt->key_stream, ckpt->key_pts);
+    return 1;
+}
+
+// 1. 选择写断点的流：第一路视频流，没有视频流时用第一路音频流
+// 2. 续转时各流丢弃已写出的部分：断点所在的流从断点关键帧开始编码，直接复用的流和其他视频流从最后写出的
+//    packet之后开始，重新编码的音频流从最后写出的packet的结束采样点开始，在写入aud_fifo时截掉帧内之前的采样点
+// 3. 续转时将输入定位到各流起点中最早者之前的关键帧
+static int init_checkpoint(transcode_ctx_t *tc, bool resume) {
+    output_ctx_t *of = &tc->outputs[0];
+    checkpoint_t *ckpt = &of->ckpt;
+    int64_t seek_ts = INT64_MAX;
+    int ret;
+
+    // 1
+    of->ckpt_stream = -1;
+    for (int i = 0; i < tc->nb_streams && of->ckpt_stream < 0; i++) {
+        if (!tc->sctxs[i].discard && tc->sctxs[i].i_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            of->ckpt_stream = i;
+        }
+    }
+    for (int i = 0; i < tc->nb_streams && of->ckpt_stream < 0; i++) {
+        if (!tc->sctxs[i].discard && tc->sctxs[i].i_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            of->ckpt_stream = i;
+        }
+    }
+    if (of->ckpt_stream < 0) {
+        av_log(NULL, AV_LOG_WARNING, "No audio or video stream, checkpoints disabled\n");
+        return 0;
+    }
+    of->ckpt_interval = av_rescale_q(tc->opt->checkpoint_interval, (AVRational){ 1, 1 },
+                                     of->osts[of->ckpt_stream].o_stream->time_base);
+    if (!resume) {
+        return checkpoint_alloc(ckpt, tc->nb_streams);
+    }
+
+    // 2
+    for (int i = 0; i < tc->nb_streams; i++) {
+        stream_ctx_t *sctx = &tc->sctxs[i];
+        int64_t ts = (i == ckpt->key_stream) ? ckpt->key_pts : ckpt->last_dts[i];
+        if (sctx->discard || ts == AV_NOPTS_VALUE) {
+            continue;
+        }
+        ostream_ctx_t *ost = &of->osts[i];
+        AVRational otb = ost->o_stream->time_base;
+        if (is_transcoded(sctx) && ost->o_codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (ost->aud_fifo || of->oafifo[i])) {
+            if (i != ckpt->key_stream && ckpt->end_ts[i] != AV_NOPTS_VALUE) {
+                ts = ckpt->end_ts[i];
+            }
+            if (!ost->aud_fifo) {
+                // 解码帧与编码器帧尺寸相同时原本不经过aud_fifo，续转时需要它从帧内截取
+                ost->aud_fifo = of->oafifo[i];
+                if (!(ost->fifo_frame = av_frame_alloc())) {
+                    return AVERROR(ENOMEM);
+                }
+            }
+            ost->trim_pts = av_rescale_q(ts, otb, ost->o_codec_ctx->time_base);
+            ost->drop_end = ts;
+        } else if (is_transcoded(sctx)) {
+            sctx->start_pts = av_rescale_q(ts, otb, sctx->dec_tb) + (i == ckpt->key_stream ? 0 : 1);
+        } else if (ckpt->last_dts[i] != AV_NOPTS_VALUE) {
+            sctx->resume_dts = av_rescale_q(ckpt->last_dts[i], otb, sctx->i_stream->time_base);
+        }
+        seek_ts = FFMIN(seek_ts, av_rescale_q(ts, otb, AV_TIME_BASE_Q));
+    }
+
+    // 3
+    if (seek_ts != INT64_MAX) {
+        ret = avformat_seek_file(tc->ictx.fmt_ctx, -1, INT64_MIN, seek_ts, seek_ts, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Seek to checkpoint %"PRId64" failed\n", seek_ts);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// 启动各阶段线程：一个解复用线程，每路音视频流各一个解码、滤镜线程，
+// 每个输出文件中每路音视频流各一个编码线程，每个输出文件一个复用线程
+static int start_threads(transcode_ctx_t *tc) {
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        output_ctx_t *of = &tc->outputs[k];
+        of->mux_tid = SDL_CreateThread(mux_thread, "mux_thread", of);
+        if (!of->mux_tid) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+            return AVERROR(ENOMEM);
+        }
+        for (int i = 0; i < tc->nb_streams; i++) {
+            if (!is_transcoded(&tc->sctxs[i])) {
+                continue;
+            }
+            of->osts[i].encode_tid = SDL_CreateThread(encode_thread, "encode_thread", &of->osts[i]);
+            if (!of->osts[i].encode_tid) {
+                av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+                return AVERROR(ENOMEM);
+            }
+        }
+    }
+
+    for (int i = 0; i < tc->nb_streams; i++) {
+        stream_ctx_t *sctx = &tc->sctxs[i];
+        if (!is_transcoded(sctx)) {
+            continue;
+        }
+        sctx->decode_tid = SDL_CreateThread(decode_thread, "decode_thread", sctx);
+        if (sctx->flt_ctx) {
+            sctx->filter_tid = SDL_CreateThread(filter_thread, "filter_thread", sctx);
+        }
+        if (!sctx->decode_tid || (sctx->flt_ctx && !sctx->filter_tid)) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    tc->demux_tid = SDL_CreateThread(demux_thread, "demux_thread", tc);
+    if (!tc->demux_tid) {
+        av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static void wait_threads(transcode_ctx_t *tc) {
+    SDL_WaitThread(tc->demux_tid, NULL);
+    for (int i = 0; i < tc->nb_streams && tc->sctxs; i++) {
+        stream_ctx_t *sctx = &tc->sctxs[i];
+        SDL_WaitThread(sctx->decode_tid, NULL);
+        SDL_WaitThread(sctx->filter_tid, NULL);
+    }
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        output_ctx_t *of = &tc->outputs[k];
+        for (int i = 0; i < tc->nb_streams && of->osts; i++) {
+            SDL_WaitThread(of->osts[i].encode_tid, NULL);
+        }
+        SDL_WaitThread(of->mux_tid, NULL);
+    }
+}
+
+static void output_deinit(output_ctx_t *of, int nb_streams) {
+    for (int i = 0; i < nb_streams; i++) {
+        if (of->osts) {
+            ostream_ctx_t *ost = &of->osts[i];
+            av_queue_destroy(&ost->enc_queue, free_frame_item);
+            av_queue_destroy(&ost->mux_queue, free_packet_item);
+            av_frame_free(&ost->fifo_frame);
+        }
+        if (of->octx.codec_ctx) {
+            avcodec_free_context(&of->octx.codec_ctx[i]);
+        }
+        if (of->oafifo && of->oafifo[i]) {
+            av_audio_ring_free(&of->oafifo[i]);
+        }
+    }
+    SDL_DestroySemaphore(of->mux_sem);
+    checkpoint_free(&of->ckpt);
+
+    av_free(of->octx.codec_ctx);
+    av_free(of->oafifo);
+    av_free(of->osts);
+
+    if (of->octx.writer) {
+        async_writer_free(&of->octx.writer);
+        if (of->octx.fmt_ctx) {
+            of->octx.fmt_ctx->pb = NULL;
+        }
+    } else if (of->octx.fmt_ctx && !(of->octx.fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&of->octx.fmt_ctx->pb);
+    }
+    avformat_free_context(of->octx.fmt_ctx);
+}
+
+static void transcode_deinit(transcode_ctx_t *tc) {
+    for (int k = 0; k < tc->nb_outputs; k++) {
+        output_deinit(&tc->outputs[k], tc->nb_streams);
+    }
+    for (int i = 0; i < tc->nb_streams; i++) {
+        if (tc->sctxs) {
+            stream_ctx_t *sctx = &tc->sctxs[i];
+            av_queue_destroy(&sctx->dec_queue, free_packet_item);
+            av_queue_destroy(&sctx->flt_queue, free_frame_item);
+            av_dedup_free(&sctx->dedup);
+        }
+        if (tc->ictx.codec_ctx) {
+            avcodec_free_context(&tc->ictx.codec_ctx[i]);
+        }
+        if (tc->ictx.bsf_ctx) {
+            av_bsf_free(&tc->ictx.bsf_ctx[i]);
+        }
+        if (tc->fctxs) {
+            deinit_filters(&tc->fctxs[i]);
+        }
+    }
+    av_pool_destroy(&tc->pkt_pool);
+    av_pool_destroy(&tc->frm_pool);
+    SDL_DestroyMutex(tc->err_mutex);
+
+    av_free(tc->ictx.codec_ctx);
+    av_free(tc->ictx.bsf_ctx);
+    av_free(tc->fctxs);
+    av_free(tc->sctxs);
+
+    avio_mmap_close_input(&tc->ictx.fmt_ctx);
+}
+
+void transcode_opt_init(transcode_opt_t *opt) {
+    memset(opt, 0, sizeof(transcode_opt_t));
+    opt->nb_chunks = 1;
+    opt->chunk_stream = -1;
+    opt->chunk_start = AV_NOPTS_VALUE;
+    opt->chunk_end = AV_NOPTS_VALUE;
+    opt->trim_start = AV_NOPTS_VALUE;
+    opt->trim_end = AV_NOPTS_VALUE;
+    opt->checkpoint_interval = 10;
+}
+
+int transcode(const transcode_opt_t *opt, transcode_stats_t *stats) {
+    transcode_ctx_t tc;
+    int ret;
+
+    memset(&tc, 0, sizeof(tc));
+    tc.opt = opt;
+    tc.err_mutex = SDL_CreateMutex();
+    if (!tc.err_mutex) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if (opt->nb_outputs < 1 || opt->nb_outputs > MAX_OUTPUTS) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid number of outputs %d\n", opt->nb_outputs);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (opt->checkpoint_fname && !can_checkpoint(opt)) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    // 1. 初始化：打开输入，打开各输出，初始化滤镜
+    thread_plan_init(&tc.threads, opt->nb_cores, opt->outputs, opt->nb_outputs);
+    thread_plan_log(&tc.threads, opt->nb_outputs);
+    ret = open_input_file(opt->in_fname, opt->in_fmt_name, opt->in_mmap, opt->maps, opt->nb_maps,
+                          is_stream_copy(opt, AVMEDIA_TYPE_VIDEO), is_stream_copy(opt, AVMEDIA_TYPE_AUDIO),
+                          tc.threads.v_dec_threads, tc.threads.a_dec_threads, &tc.ictx);
+    if (ret < 0) {
+        goto end;
+    }
+    tc.nb_streams = tc.ictx.fmt_ctx->nb_streams;
+    ret = init_bsfs(&tc);
+    if (ret < 0) {
+        goto end;
+    }
+    if (opt->chunk_start != AV_NOPTS_VALUE) {
+        // 定位到本段的起始关键帧
+        ret = avformat_seek_file(tc.ictx.fmt_ctx, opt->chunk_stream,
+                                 INT64_MIN, opt->chunk_start, opt->chunk_start, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Seek to chunk start %"PRId64" failed\n", opt->chunk_start);
+            goto end;
+        }
+    }
+    if (opt->trim_start != AV_NOPTS_VALUE) {
+        // -ss：定位到截取起点之前最近的关键帧，只从这里开始读取和解码
+        int64_t ts = input_ts(tc.ictx.fmt_ctx, opt->trim_start);
+        ret = avformat_seek_file(tc.ictx.fmt_ctx, -1, INT64_MIN, ts, ts, 0);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Seek to trim start %"PRId64" failed\n", opt->trim_start);
+            goto end;
+        }
+    }
+    for (int k = 0; k < opt->nb_outputs; k++) {
+        tc.oopts[k] = opt->outputs[k];
+    }
+    if (opt->v_filters && (ret = probe_filtered_size(&tc)) < 0) {
+        goto end;
+    }
+    bool resume = false;
+    if (opt->checkpoint_fname) {
+        if ((ret = load_checkpoint(&tc)) < 0) {
+            goto end;
+        }
+        resume = ret > 0;
+    }
+    for (int k = 0; k < opt->nb_outputs; k++) {
+        output_ctx_t *of = &tc.outputs[k];
+        of->opt = &tc.oopts[k];
+        of->ckpt_stream = -1;
+        of->idx = k;
+        of->tc = &tc;
+        tc.nb_outputs++;
+        of->mux_sem = SDL_CreateSemaphore(0);
+        if (!of->mux_sem) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = open_output_file(of->opt, &tc.ictx, opt->v_enc_name, opt->a_enc_name, tc.threads.v_enc_threads[k],
+                               tc.threads.a_enc_threads, &of->octx, &of->oafifo);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    ret = init_filters(&tc);
+    if (ret < 0) {
+        goto end;
+    }
+
+    // 2. 为每路流创建连接各阶段的队列
+    ret = init_streams(&tc);
+    if (ret < 0) {
+        goto end;
+    }
+    if (opt->checkpoint_fname && (ret = init_checkpoint(&tc, resume)) < 0) {
+        goto end;
+    }
+
+    // 3. 启动各阶段线程
+    int64_t start_time = av_gettime_relative();
+    ret = start_threads(&tc);
+    if (ret < 0) {
+        abort_pipeline(&tc, ret);
+    }
+
+    // 4. 等待各阶段线程退出
+    wait_threads(&tc);
+    tc.wall_us = av_gettime_relative() - start_time;
+    if (tc.err < 0) {
+        ret = tc.err;
+    }
+    if (opt->report_fname && ret >= 0) {
+        ret = write_report(&tc, opt->report_fname);
+    }
+    if (opt->checkpoint_fname && ret >= 0) {
+        // 转码已完成，下次运行同一命令应从头开始
+        remove(opt->checkpoint_fname);
+    }
+    if (stats) {
+        stats->nb_packet_allocs = tc.pkt_pool.nb_allocs;
+        stats->nb_packet_gets = tc.pkt_pool.nb_gets;
+        stats->nb_frame_allocs = tc.frm_pool.nb_allocs;
+        stats->nb_frame_gets = tc.frm_pool.nb_gets;
+        stats->wall_us = tc.wall_us;
+        for (int i = 0; i < tc.nb_streams; i++) {
+            const stream_ctx_t *sctx = &tc.sctxs[i];
+            if (sctx->i_stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                stats->nb_video_frames += sctx->nb_frames;
+            }
+            stage_stat_merge(&stats->demux_stat, &sctx->demux_stat);
+            stage_stat_merge(&stats->decode_stat, &sctx->decode_stat);
+            stage_stat_merge(&stats->filter_stat, &sctx->filter_stat);
+            for (int k = 0; k < tc.nb_outputs; k++) {
+                stage_stat_merge(&stats->encode_stat, &tc.outputs[k].osts[i].encode_stat);
+                stage_stat_merge(&stats->mux_stat, &tc.outputs[k].osts[i].mux_stat);
+            }
+        }
+    }
+    av_log(NULL, AV_LOG_INFO, "AVPacket: %"PRId64" allocated, %"PRId64" used; "
+           "AVFrame: %"PRId64" allocated, %"PRId64" used\n",
+           tc.pkt_pool.nb_allocs, tc.pkt_pool.nb_gets, tc.frm_pool.nb_allocs, tc.frm_pool.nb_gets);
+
+end:
+    if (ret < 0 && ret != AVERROR_EXIT) {
+        av_log(NULL, AV_LOG_ERROR, "Error occurred: %s\n", av_err2str(ret));
+    }
+
+    transcode_deinit(&tc);
+
+    return ret;
+}
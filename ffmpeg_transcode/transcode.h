@@ -0,0 +1,189 @@
+#ifndef __TRANSCODE_H__
+#define __TRANSCODE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include "av_audio_ring.h"
+#include "av_dedup.h"
+#include "av_filter.h"
+#include "av_pool.h"
+#include "av_queue.h"
+#include "av_stats.h"
+#include "checkpoint.h"
+#include "open_file.h"
+#include "thread_plan.h"
+
+// 流水线各阶段之间队列的容量。packet较小，可多缓存一些；frame是解码后的原始数据，占用内存较大
+#define PKT_QUEUE_SIZE      64
+#define FRM_QUEUE_SIZE      8
+// 对象池中每路流在队列容量之外额外缓存的对象个数，用于各阶段线程正在处理的frame/packet
+#define POOL_EXTRA_SIZE     8
+
+// 一个输入最多对应的输出文件个数，每个输出文件对应滤镜图的一个输出
+#define MAX_OUTPUTS         MAX_FILTER_OUTPUTS
+// 流说明符(-map)的最大个数
+#define MAX_MAPS            32
+
+typedef struct {
+    const char *in_fname;
+    const char *in_fmt_name;        // 输入封装格式，NULL表示自动探测
+    bool in_mmap;                   // 本地输入文件通过内存映射读取，见avio_mmap.h
+    const char *maps[MAX_MAPS];     // 只处理与这些流说明符匹配的输入流，见select_streams()
+    int nb_maps;                    // 0表示处理全部输入流
+    output_opt_t outputs[MAX_OUTPUTS];  // 输入只解码一次，按各输出的参数分别缩放、编码、复用
+    int nb_outputs;
+    const char *v_enc_name;         // 编码器名，"copy"表示直接复制码流，不解码也不编码
+    const char *a_enc_name;
+    const char *v_filters;          // 作用于每路视频流的滤镜描述，如"crop=1280:720,hflip"，可为NULL
+    const char *a_filters;          // 作用于每路音频流的滤镜描述，如"volume=0.5"，可为NULL
+    const char *v_bsf_name;         // 直接复制的视频流使用的码流滤镜，如h264_mp4toannexb，可为NULL
+    const char *a_bsf_name;         // 直接复制的音频流使用的码流滤镜，如aac_adtstoasc，可为NULL
+    int nb_chunks;                  // 大于1时将输入按关键帧切分为nb_chunks段并行转码，见chunk.c
+    const char *report_fname;       // 转码结束后将各阶段耗时统计写入此JSON文件，可为NULL，见report.c
+    int nb_cores;                   // 本任务的核预算，按此分配各编解码器和滤镜图的线程数，0表示本机全部核
+    int64_t trim_start;             // 截取区间，相对输入起点，单位AV_TIME_BASE，AV_NOPTS_VALUE表示不限制
+    int64_t trim_end;
+    bool smart_render;              // 截取时只重新编码切点所在的GOP，其余直接复制，见smart_trim.c
+    const char *checkpoint_fname;   // 断点文件，文件存在时从断点续转，转码成功后删除，可为NULL，见checkpoint.h
+    int checkpoint_interval;        // 相邻断点的最小间隔，单位秒
+    int nb_thumbs;                  // 大于0时不转码，只生成nb_thumbs个缩略图拼成的拼图，见thumbnail.h
+    int thumb_cols;                 // 拼图的列数，0表示默认值
+    int thumb_rows;                 // 每张拼图的行数，0表示全部缩略图拼成一张
+    bool dedup;                     // 视频解码后丢弃与前一帧几乎相同的帧，输出为可变帧率，见av_dedup.h
+
+    // 以下由分块转码内部使用：只转码chunk_stream流中[chunk_start, chunk_end)区间内的帧，
+    // 时间单位为该流的时基，AV_NOPTS_VALUE表示不限制。chunk_start必须是关键帧的pts
+    int chunk_stream;
+    int64_t chunk_start;
+    int64_t chunk_end;
+    int chunk_only;                 // 只转码chunk_stream，丢弃其他流
+}   transcode_opt_t;
+
+// 转码结束后的统计信息
+typedef struct {
+    int64_t nb_packet_allocs;       // 实际分配AVPacket的次数，稳定运行后不再增长
+    int64_t nb_packet_gets;         // 使用AVPacket的次数
+    int64_t nb_frame_allocs;        // 实际分配AVFrame的次数，稳定运行后不再增长
+    int64_t nb_frame_gets;          // 使用AVFrame的次数
+
+    // 以下用于分块转码时汇总各段的运行报告，各阶段耗时是所有流(及所有输出)的合计
+    int64_t wall_us;                // 从启动各阶段线程到全部退出的耗时
+    int64_t nb_video_frames;        // 解码的视频帧数
+    stage_stat_t demux_stat;
+    stage_stat_t decode_stat;
+    stage_stat_t filter_stat;
+    stage_stat_t encode_stat;
+    stage_stat_t mux_stat;
+}   transcode_stats_t;
+
+typedef struct transcode_ctx_t transcode_ctx_t;
+typedef struct stream_ctx_t stream_ctx_t;
+typedef struct output_ctx_t output_ctx_t;
+
+// 一路输入流在一个输出文件中对应的输出流。音视频流拥有各自的编码器和编码线程
+typedef struct {
+    AVCodecContext* o_codec_ctx;    // 字幕等直接复用的流为NULL
+    AVStream* o_stream;             // 未选中的输入流为NULL
+    av_audio_ring_t* aud_fifo;      // 编码器帧尺寸与解码帧尺寸不一致时使用，否则为NULL
+    AVFrame* fifo_frame;            // 从aud_fifo中读出的音频帧，各次读取之间复用
+    int64_t trim_pts;               // 续转时音频帧写入aud_fifo前截掉pts小于此值的采样点，单位是编码器时基，
+                                    // AV_NOPTS_VALUE表示不截取
+    int64_t drop_end;               // 续转时丢弃结束时间不大于此值的packet，即重新打开的编码器输出的起始填充，
+                                    // 单位是输出流时基，AV_NOPTS_VALUE表示不丢弃
+
+    stream_ctx_t *ist;
+    output_ctx_t *of;
+    av_queue_t enc_queue;           // filter -> encode, AVFrame *
+    av_queue_t mux_queue;           // encode -> mux,    AVPacket *，字幕等流由demux直接写入
+    SDL_Thread *encode_tid;
+
+    stage_stat_t encode_stat;       // av_encode_frame()，由编码线程更新
+    stage_stat_t mux_stat;          // av_interleaved_write_frame()，由复用线程更新
+    stage_stat_t mux_wait_stat;     // 向mux_queue写入时的等待，即编码线程(直接复用的流为解复用线程)被输出阻塞的时间
+    int64_t nb_frames;              // 送入编码器的帧数
+}   ostream_ctx_t;
+
+// 每路输入流一个上下文。音视频流拥有各自的解码器、滤镜图，以及解码、滤镜线程
+// 滤镜图的第k个输出送往第k个输出文件的编码器
+struct stream_ctx_t {
+    AVFormatContext* i_fmt_ctx;
+    AVCodecContext* i_codec_ctx;
+    filter_ctx_t* flt_ctx;          // 字幕等直接复用的流，以及解码帧无需处理直接编码的流为NULL
+    AVBSFContext* bsf_ctx;          // 直接复用的流使用的码流滤镜，可为NULL
+    AVStream* i_stream;
+    int stream_idx;
+    AVRational dec_tb;              // 解码前packet时间戳转换到此时基，与各输出的编码器时基相同
+    int64_t start_pts;              // 解码后pts小于此值的帧丢弃，单位是dec_tb，AV_NOPTS_VALUE表示不丢弃
+    int64_t resume_dts;             // 续转时直接复用的流丢弃dts不大于此值的packet，单位是输入流时基，AV_NOPTS_VALUE表示不丢弃
+    int64_t ts_offset;              // -ss：解复用后packet时间戳减去此值，使输出从0开始，单位是输入流时基
+    int64_t end_dts;                // -t/-to：dts(无dts时用pts)不小于此值的packet到达即结束此流，单位是输入流时基，未减ts_offset
+    int64_t end_pts;                // -t/-to及分块转码的块终点：解码后pts不小于此值的帧丢弃，单位是dec_tb。均以AV_NOPTS_VALUE表示不限制
+    bool discard;                   // 此流不处理，解复用时丢弃其packet。未选中的流在输出文件中也没有对应的流
+    bool eof;                       // 解复用阶段已结束此流
+
+    transcode_ctx_t *tc;
+    av_queue_t dec_queue;           // demux  -> decode, AVPacket *
+    av_queue_t flt_queue;           // decode -> filter, AVFrame *，无滤镜图时解码帧直接送入各输出的enc_queue
+    av_dedup_t *dedup;              // 视频流的重复帧消除，由解码线程使用，未启用时为NULL
+    SDL_Thread *decode_tid;
+    SDL_Thread *filter_tid;
+
+    stage_stat_t demux_stat;        // av_read_frame()，由解复用线程更新
+    stage_stat_t decode_stat;       // av_decode_frame()，由解码线程更新
+    stage_stat_t filter_stat;       // 滤镜图输入输出，由滤镜线程更新
+    int64_t nb_frames;              // 解码得到的帧数
+};
+
+// 每个输出文件一个上下文，拥有独立的复用器和复用线程
+struct output_ctx_t {
+    const output_opt_t *opt;
+    inout_ctx_t octx;
+    av_audio_ring_t **oafifo;       // av_audio_ring_t* oafifo[]
+    ostream_ctx_t *osts;            // ostream_ctx_t osts[]，与输入流一一对应
+    int idx;
+
+    transcode_ctx_t *tc;
+    SDL_Thread *mux_tid;
+    SDL_sem *mux_sem;               // 任一路流的mux_queue有新数据或状态改变时发信号，唤醒复用线程
+
+    int ckpt_stream;                // 在此流的关键帧处写断点，-1表示不写断点
+    int64_t ckpt_interval;          // 相邻断点的最小间隔，单位是ckpt_stream的输出时基
+    checkpoint_t ckpt;              // 最近一次写出的断点，由复用线程更新
+};
+
+// 转码流水线：demux -> [decode -> filter -> [encode -> mux] x M] x N
+// 解复用一个线程，每路输入音视频流的解码、滤镜各一个线程，每个输出文件中每路音视频流的编码各一个线程，
+// 每个输出文件的复用一个线程，相邻阶段之间通过有界队列连接。输入只解码一次，滤镜图将解码帧分发(split)
+// 到各输出，各输出的复用线程按dts顺序交织各路流的输出。无需滤镜处理的流没有filter阶段，
+// 解码线程将解码帧的引用直接分发到各输出的编码队列
+struct transcode_ctx_t {
+    const transcode_opt_t *opt;
+    inout_ctx_t ictx;
+    filter_ctx_t *fctxs;            // filter_ctx_t fctxs[]
+    stream_ctx_t *sctxs;            // stream_ctx_t sctxs[]
+    int nb_streams;
+    output_ctx_t outputs[MAX_OUTPUTS];
+    int nb_outputs;
+
+    thread_plan_t threads;          // 各编解码器和滤镜图的线程数
+    output_opt_t oopts[MAX_OUTPUTS];    // 各输出文件的参数，复制自opt->outputs[]。续转时设置append_pos，
+                                        // 未指定-s时设为-vf输出的图像尺寸
+    SDL_Thread *demux_tid;
+    av_pool_t pkt_pool;             // 各阶段共用的AVPacket对象池
+    av_pool_t frm_pool;             // 各阶段共用的AVFrame对象池
+
+    SDL_mutex *err_mutex;
+    int err;                        // 第一个出错阶段的错误码
+
+    int64_t wall_us;                // 从启动各阶段线程到全部退出的耗时
+};
+
+void transcode_opt_init(transcode_opt_t *opt);
+// stats可为NULL
+int transcode(const transcode_opt_t *opt, transcode_stats_t *stats);
+
+#endif
@@ -4,8 +4,8 @@
 
 static void sdl_audio_callback(void *opaque, Uint8 *stream, int len);
 
-// 从packet_queue中取一个packet，解码生成frame
-static int audio_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt_queue, AVFrame *frame)
+// 从packet_queue中取一个packet，解码生成frame。pkt_serial是解码器当前解码的packet的播放序列
+static int audio_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt_queue, int *pkt_serial, AVFrame *frame)
 {
     int ret;
     
@@ -18,6 +18,12 @@ static int audio_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt
             //if (d->queue->abort_request)
             //    return -1;
 
+            // 已seek，解码器中的帧属于过期的播放序列，不再接收
+            if (*pkt_serial != p_pkt_queue->serial)
+            {
+                break;
+            }
+
             // 3.2 一个音频packet含一至多个音频frame，每次avcodec_receive_frame()返回一个frame，此函数返回。
             // 下次进来此函数，继续获取一个frame，直到avcodec_receive_frame()返回AVERROR(EAGAIN)，
             // 表示解码器需要填入新的音频packet
@@ -55,11 +61,18 @@ static int audio_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt
             }
         }
 
-        // 1. 取出一个packet。使用pkt对应的serial赋值给d->pkt_serial
-        if (packet_queue_get(p_pkt_queue, &pkt, true) < 0)
+        // 1. 取出一个packet。使用pkt对应的serial赋值给d->pkt_serial，seek之前写入的packet直接丢弃
+        do
         {
-            return -1;
-        }
+            if (packet_queue_get(p_pkt_queue, &pkt, true, pkt_serial) < 0)
+            {
+                return -1;
+            }
+            if (*pkt_serial != p_pkt_queue->serial)
+            {
+                av_packet_unref(&pkt);
+            }
+        } while (*pkt_serial != p_pkt_queue->serial);
 
         // packet_queue中第一个总是flush_pkt。每次seek操作会插入flush_pkt，更新serial，开启新的播放序列
         if (pkt.data == NULL)
@@ -100,7 +113,7 @@ static int audio_decode_thread(void *arg)
 
     while (1)
     {
-        got_frame = audio_decode_frame(is->p_acodec_ctx, &is->audio_pkt_queue, p_frame);
+        got_frame = audio_decode_frame(is->p_acodec_ctx, &is->audio_pkt_queue, &is->audio_pkt_serial, p_frame);
         if (got_frame < 0)
         {
             goto the_end;
@@ -115,7 +128,7 @@ static int audio_decode_thread(void *arg)
 
             af->pts = (p_frame->pts == AV_NOPTS_VALUE) ? NAN : p_frame->pts * av_q2d(tb);
             af->pos = p_frame->pkt_pos;
-            //-af->serial = is->auddec.pkt_serial;
+            af->serial = is->audio_pkt_serial;
             // 当前帧包含的(单个声道)采样数/采样率就是当前帧的播放时长
             af->duration = av_q2d((AVRational){p_frame->nb_samples, p_frame->sample_rate});
 
@@ -182,7 +195,7 @@ int open_audio_stream(player_stat_t *is)
     return 0;
 }
 
-static int audio_resample(player_stat_t *is, int64_t audio_callback_time)
+static int audio_resample(player_stat_t *is)
 {
     int data_size, resampled_data_size;
     int64_t dec_channel_layout;
@@ -190,19 +203,14 @@ static int audio_resample(player_stat_t *is, int64_t audio_callback_time)
     int wanted_nb_samples;
     frame_t *af;
 
-#if defined(_WIN32)
-    while (frame_queue_nb_remaining(&is->audio_frm_queue) == 0)
+    // 若队列头部可读，则由af指向可读帧。seek之前解码的帧直接丢弃
+    // 在SDL音频回调中执行，不等待解码线程，队列为空时返回-1，由回调输出静音
+    do
     {
-        if ((av_gettime_relative() - audio_callback_time) > 1000000LL * is->audio_hw_buf_size / is->audio_param_tgt.bytes_per_sec / 2)
+        if (!(af = frame_queue_peek_readable(&is->audio_frm_queue)))
             return -1;
-        av_usleep(1000);
-    }
-#endif
-
-    // 若队列头部可读，则由af指向可读帧
-    if (!(af = frame_queue_peek_readable(&is->audio_frm_queue)))
-        return -1;
-    frame_queue_next(&is->audio_frm_queue);
+        frame_queue_next(&is->audio_frm_queue);
+    } while (af->serial != is->audio_pkt_queue.serial);
 
     // 根据frame中指定的音频参数获取缓冲区的大小
     data_size = av_samples_get_buffer_size(NULL, af->frame->channels,   // 本行两参数：linesize，声道数
@@ -388,7 +396,7 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
         if (is->audio_cp_index >= (int)is->audio_frm_size)
         {
            // 1. 从音频frame队列中取出一个frame，转换为音频设备支持的格式，返回值是重采样音频帧的大小
-           audio_size = audio_resample(is, audio_callback_time);
+           audio_size = audio_resample(is);
            if (audio_size < 0)
            {
                 /* if error, just output silence */
@@ -1,4 +1,5 @@
 ﻿#include "demux.h"
+#include "keyindex.h"
 #include "packet.h"
 
 static int decode_interrupt_cb(void *ctx)
@@ -28,7 +29,8 @@ static int demux_init(player_stat_t *is)
 
     // 1. 构建AVFormatContext
     // 1.1 打开视频文件：读取文件头，将文件格式信息存储在"fmt context"中
-    err = avformat_open_input(&p_fmt_ctx, is->filename, NULL, NULL);
+    //     use_mmap时本地文件通过内存映射读取，不是普通文件时回退到默认的file协议
+    err = avio_mmap_open_input(&p_fmt_ctx, is->filename, NULL, NULL, is->use_mmap);
     if (err < 0)
     {
         printf("avformat_open_input() failed %d\n", err);
@@ -76,7 +78,7 @@ static int demux_init(player_stat_t *is)
  fail:
         if (p_fmt_ctx != NULL)
         {
-            avformat_close_input(&p_fmt_ctx);
+            avio_mmap_close_input(&p_fmt_ctx);
         }
         return ret;
     }
@@ -99,7 +101,53 @@ static int stream_has_enough_packets(AVStream *st, int stream_id, packet_queue_t
     return stream_id < 0 ||
            queue->abort_request ||
            (st->disposition & AV_DISPOSITION_ATTACHED_PIC) ||
-           queue->nb_packets > MIN_FRAMES && (!queue->duration || av_q2d(st->time_base) * queue->duration > 1.0);
+           packet_queue_nb_packets(queue) > MIN_FRAMES && (!queue->duration || av_q2d(st->time_base) * queue->duration > 1.0);
+}
+
+// 执行主线程请求的seek
+// 1. 关键帧索引已覆盖目标位置时按字节偏移直接定位，否则由解复用器按时间戳查找关键帧
+// 2. 两个packet队列开始新的播放序列，解码线程据此丢弃seek之前的packet和帧，并冲洗解码器
+static void stream_seek(player_stat_t *is)
+{
+    int64_t seek_target = is->seek_pos;
+    int64_t seek_min = is->seek_rel > 0 ? seek_target - is->seek_rel + 2 : INT64_MIN;
+    int64_t seek_max = is->seek_rel < 0 ? seek_target - is->seek_rel - 2 : INT64_MAX;
+    int64_t pos;
+    int ret;
+
+    // 1
+    pos = keyframe_index_lookup(&is->keyindex, seek_min, seek_target, seek_max);
+    if (pos >= 0)
+    {
+        ret = avformat_seek_file(is->p_fmt_ctx, -1, pos, pos, pos, AVSEEK_FLAG_BYTE);
+    }
+    else
+    {
+        ret = avformat_seek_file(is->p_fmt_ctx, -1, seek_min, seek_target, seek_max, 0);
+    }
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "%s: error while seeking\n", is->filename);
+    }
+    else
+    {
+        // 2
+        if (is->audio_idx >= 0)
+        {
+            packet_queue_put_flushpacket(&is->audio_pkt_queue);
+        }
+        if (is->video_idx >= 0)
+        {
+            packet_queue_put_flushpacket(&is->video_pkt_queue);
+        }
+        is->eof = 0;
+        // 暂停时播放一帧，显示seek后的画面
+        if (is->paused)
+        {
+            step_to_next_frame(is);
+        }
+    }
+    is->seek_req = 0;
 }
 
 /* this thread gets the stream from the disk or the network */
@@ -121,9 +169,14 @@ static int demux_thread(void *arg)
         {
             break;
         }
+
+        if (is->seek_req)
+        {
+            stream_seek(is);
+        }
         
         /* if the queue are full, no need to read more */
-        if (is->audio_pkt_queue.size + is->video_pkt_queue.size > MAX_QUEUE_SIZE ||
+        if (packet_queue_size(&is->audio_pkt_queue) + packet_queue_size(&is->video_pkt_queue) > MAX_QUEUE_SIZE ||
             (stream_has_enough_packets(is->p_audio_stream, is->audio_idx, &is->audio_pkt_queue) &&
              stream_has_enough_packets(is->p_video_stream, is->video_idx, &is->video_pkt_queue)))
         {
@@ -138,7 +191,7 @@ static int demux_thread(void *arg)
         ret = av_read_frame(is->p_fmt_ctx, pkt);
         if (ret < 0)
         {
-            if ((ret == AVERROR_EOF))// || avio_feof(ic->pb)) && !is->eof)
+            if ((ret == AVERROR_EOF) && !is->eof)// || avio_feof(ic->pb))
             {
                 // 输入文件已读完，则往packet队列中发送NULL packet，以冲洗(flush)解码器，否则解码器中缓存的帧取不出来
                 if (is->video_idx >= 0)
@@ -149,6 +202,7 @@ static int demux_thread(void *arg)
                 {
                     packet_queue_put_nullpacket(&is->audio_pkt_queue, is->audio_idx);
                 }
+                is->eof = 1;
             }
 
             SDL_LockMutex(wait_mutex);
@@ -195,6 +249,12 @@ int open_demux(player_stat_t *is)
         return -1;
     }
 
+    // 不支持按字节seek的格式(如MP4)文件中本身带有完整的索引，不需要另建
+    if (is->use_keyindex && is->video_idx >= 0 && !(is->p_fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK))
+    {
+        keyframe_index_start(is);
+    }
+
     is->read_tid = SDL_CreateThread(demux_thread, "demux_thread", is);
     if (is->read_tid == NULL)
     {
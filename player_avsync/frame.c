@@ -46,6 +46,13 @@ void frame_queue_signal(frame_queue_t *f)
     SDL_UnlockMutex(f->mutex);
 }
 
+// 消费者释放一帧后调用，只有生产者在等待时才加锁
+static void frame_queue_wakeup(frame_queue_t *f)
+{
+    if (SDL_AtomicGet(&f->sleeping))
+        frame_queue_signal(f);
+}
+
 frame_t *frame_queue_peek(frame_queue_t *f)
 {
     return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
@@ -63,15 +70,20 @@ frame_t *frame_queue_peek_last(frame_queue_t *f)
 }
 
 // 向队列尾部申请一个可写的帧空间，若无空间可写，则等待
+// 先置sleeping再检查帧数，与frame_queue_next()中"先减帧数再检查sleeping"配合，不会丢失唤醒
 frame_t *frame_queue_peek_writable(frame_queue_t *f)
 {
     /* wait until we have space to put a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size >= f->max_size &&
-           !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
+    if (SDL_AtomicGet(&f->size) >= f->max_size) {
+        SDL_LockMutex(f->mutex);
+        SDL_AtomicSet(&f->sleeping, 1);
+        while (SDL_AtomicGet(&f->size) >= f->max_size &&
+               !f->pktq->abort_request) {
+            SDL_CondWait(f->cond, f->mutex);
+        }
+        SDL_AtomicSet(&f->sleeping, 0);
+        SDL_UnlockMutex(f->mutex);
     }
-    SDL_UnlockMutex(f->mutex);
 
     if (f->pktq->abort_request)
         return NULL;
@@ -79,32 +91,23 @@ frame_t *frame_queue_peek_writable(frame_queue_t *f)
     return &f->queue[f->windex];
 }
 
-// 从队列头部读取一帧，只读取不删除，若无帧可读则等待
+// 从队列头部读取一帧，只读取不删除，若无帧可读则立即返回NULL
+// 在音频回调中调用，不能阻塞，无帧可读时由调用者输出静音
 frame_t *frame_queue_peek_readable(frame_queue_t *f)
 {
-    /* wait until we have a readable a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size - f->rindex_shown <= 0 &&
-           !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
-    }
-    SDL_UnlockMutex(f->mutex);
-
-    if (f->pktq->abort_request)
+    if (f->pktq->abort_request || frame_queue_nb_remaining(f) <= 0)
         return NULL;
 
     return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
 }
 
 // 向队列尾部压入一帧，只更新计数与写指针，因此调用此函数前应将帧数据写入队列相应位置
+// 帧数的原子加法在帧数据写入之后，消费者读到新的帧数时一定能看到完整的帧
 void frame_queue_push(frame_queue_t *f)
 {
     if (++f->windex == f->max_size)
         f->windex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size++;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    SDL_AtomicAdd(&f->size, 1);
 }
 
 // 读指针(rindex)指向的帧已显示，删除此帧，注意不读取直接删除。读指针加1
@@ -117,17 +120,15 @@ void frame_queue_next(frame_queue_t *f)
     frame_queue_unref_item(&f->queue[f->rindex]);
     if (++f->rindex == f->max_size)
         f->rindex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size--;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    SDL_AtomicAdd(&f->size, -1);
+    frame_queue_wakeup(f);
 }
 
 // frame_queue中未显示的帧数
 /* return the number of undisplayed frames in the queue */
 int frame_queue_nb_remaining(frame_queue_t *f)
 {
-    return f->size - f->rindex_shown;
+    return SDL_AtomicGet(&f->size) - f->rindex_shown;
 }
 
 /* return last shown position */
@@ -0,0 +1,185 @@
+﻿#include "keyindex.h"
+
+static int keyindex_interrupt_cb(void *ctx)
+{
+    keyframe_index_t *ki = ctx;
+    return ki->abort_request;
+}
+
+// 追加一个关键帧。只保留ts递增的关键帧，保证可以二分查找
+static int keyframe_index_add(keyframe_index_t *ki, int64_t ts, int64_t pos)
+{
+    int ret = 0;
+
+    SDL_LockMutex(ki->mutex);
+    if (ki->nb_entries > 0 && ts <= ki->entries[ki->nb_entries - 1].ts)
+    {
+        goto end;
+    }
+    if (ki->nb_entries >= ki->capacity)
+    {
+        int capacity = ki->capacity ? ki->capacity * 2 : 1024;
+        keyframe_entry_t *entries = av_realloc_array(ki->entries, capacity, sizeof(keyframe_entry_t));
+        if (!entries)
+        {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ki->entries = entries;
+        ki->capacity = capacity;
+    }
+    ki->entries[ki->nb_entries].ts = ts;
+    ki->entries[ki->nb_entries].pos = pos;
+    ki->nb_entries++;
+
+end:
+    SDL_UnlockMutex(ki->mutex);
+    return ret;
+}
+
+// 后台建立关键帧索引的线程：另外打开一次输入文件，顺序读取视频流的packet，记录关键帧的时间戳和字节偏移
+// 只读packet不解码，优先级低于播放线程
+static int keyindex_thread(void *arg)
+{
+    player_stat_t *is = (player_stat_t *)arg;
+    keyframe_index_t *ki = &is->keyindex;
+    AVFormatContext *p_fmt_ctx = NULL;
+    AVPacket pkt;
+    AVRational tb;
+    int ret;
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    p_fmt_ctx = avformat_alloc_context();
+    if (!p_fmt_ctx)
+    {
+        return AVERROR(ENOMEM);
+    }
+    p_fmt_ctx->interrupt_callback.callback = keyindex_interrupt_cb;
+    p_fmt_ctx->interrupt_callback.opaque = ki;
+    // 与解复用线程使用同一解复用器，流的序号与之相同，不需要avformat_find_stream_info()
+    ret = avio_mmap_open_input(&p_fmt_ctx, is->filename, is->p_fmt_ctx->iformat, NULL, is->use_mmap);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_WARNING, "keyframe index: open %s failed %d\n", is->filename, ret);
+        return ret;
+    }
+
+    while (!ki->abort_request)
+    {
+        ret = av_read_frame(p_fmt_ctx, &pkt);
+        if (ret < 0)
+        {
+            break;
+        }
+        if (pkt.stream_index == is->video_idx && (pkt.flags & AV_PKT_FLAG_KEY) && pkt.pos >= 0)
+        {
+            int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            if (ts != AV_NOPTS_VALUE)
+            {
+                tb = p_fmt_ctx->streams[pkt.stream_index]->time_base;
+                ret = keyframe_index_add(ki, av_rescale_q(ts, tb, AV_TIME_BASE_Q), pkt.pos);
+            }
+        }
+        av_packet_unref(&pkt);
+        if (ret < 0)
+        {
+            break;
+        }
+    }
+
+    SDL_LockMutex(ki->mutex);
+    ki->complete = (ret == AVERROR_EOF);
+    av_log(NULL, AV_LOG_INFO, "keyframe index: %d keyframes%s\n", ki->nb_entries, ki->complete ? ", complete" : "");
+    SDL_UnlockMutex(ki->mutex);
+
+    avio_mmap_close_input(&p_fmt_ctx);
+    return 0;
+}
+
+int keyframe_index_start(player_stat_t *is)
+{
+    keyframe_index_t *ki = &is->keyindex;
+
+    ki->mutex = SDL_CreateMutex();
+    if (!ki->mutex)
+    {
+        printf("SDL_CreateMutex(): %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+    ki->tid = SDL_CreateThread(keyindex_thread, "keyindex_thread", is);
+    if (!ki->tid)
+    {
+        printf("SDL_CreateThread() failed: %s\n", SDL_GetError());
+        SDL_DestroyMutex(ki->mutex);
+        ki->mutex = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// 在[min_ts, max_ts]内查找不晚于ts的最后一个关键帧，没有时取min_ts之后的第一个关键帧，返回其字节偏移
+// ts超出已扫描的范围(其后可能还有更近的关键帧)或范围内没有关键帧时返回-1，由调用者按时间戳seek
+int64_t keyframe_index_lookup(keyframe_index_t *ki, int64_t min_ts, int64_t ts, int64_t max_ts)
+{
+    keyframe_entry_t *e;
+    int64_t pos = -1;
+    int lo, hi, i = -1;
+
+    if (!ki->tid)
+    {
+        return -1;
+    }
+
+    SDL_LockMutex(ki->mutex);
+    e = ki->entries;
+    if (ki->nb_entries == 0 || (!ki->complete && ts > e[ki->nb_entries - 1].ts))
+    {
+        goto end;
+    }
+    lo = 0;
+    hi = ki->nb_entries - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (e[mid].ts <= ts)
+        {
+            i = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    // 向前seek时min_ts在当前位置之后，不能停在min_ts之前，否则位置不前进
+    if (i < 0 || e[i].ts < min_ts)
+    {
+        i++;
+    }
+    if (i < ki->nb_entries && e[i].ts >= min_ts && e[i].ts <= max_ts)
+    {
+        pos = e[i].pos;
+    }
+
+end:
+    SDL_UnlockMutex(ki->mutex);
+    return pos;
+}
+
+void keyframe_index_stop(keyframe_index_t *ki)
+{
+    if (!ki->tid)
+    {
+        return;
+    }
+    ki->abort_request = 1;
+    SDL_WaitThread(ki->tid, NULL);
+    ki->tid = NULL;
+    av_freep(&ki->entries);
+    ki->nb_entries = 0;
+    ki->capacity = 0;
+    SDL_DestroyMutex(ki->mutex);
+    ki->mutex = NULL;
+}
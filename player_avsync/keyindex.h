@@ -0,0 +1,10 @@
+#ifndef __KEYINDEX_H__
+#define __KEYINDEX_H__
+
+#include "player.h"
+
+int keyframe_index_start(player_stat_t *is);
+int64_t keyframe_index_lookup(keyframe_index_t *ki, int64_t min_ts, int64_t ts, int64_t max_ts);
+void keyframe_index_stop(keyframe_index_t *ki);
+
+#endif
@@ -1,17 +1,47 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "player.h"
 
 int main(int argc, char *argv[])
 {
+    int use_mmap = 0;
+    int use_keyindex = 0;
+    int use_vsync = 0;
+
+    // -mmap: 通过内存映射读取本地文件
+    // -keyindex: 后台建立关键帧索引，加快反复seek(TS、FLV等文件中没有索引的格式)
+    // -vsync: 画面更新与显示器刷新对齐
+    while (argc > 2 && argv[1][0] == '-')
+    {
+        if (strcmp(argv[1], "-mmap") == 0)
+        {
+            use_mmap = 1;
+        }
+        else if (strcmp(argv[1], "-keyindex") == 0)
+        {
+            use_keyindex = 1;
+        }
+        else if (strcmp(argv[1], "-vsync") == 0)
+        {
+            use_vsync = 1;
+        }
+        else
+        {
+            break;
+        }
+        argv++;
+        argc--;
+    }
     if (argc != 2)
     {
         printf("Please provide a movie file, usage: \n");
-        printf("./ffplayer ring.mp4\n");
+        printf("./ffplayer [-mmap] [-keyindex] [-vsync] ring.mp4\n");
+        printf("SPACE: pause, LEFT/RIGHT: seek -/+10s, DOWN/UP: seek -/+1min, ESC: quit\n");
         return -1;
     }
     printf("Try playing %s ...\n", argv[1]);
-    player_running(argv[1]);
+    player_running(argv[1], use_mmap, use_keyindex, use_vsync);
 
     return 0;
 }
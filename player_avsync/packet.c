@@ -19,83 +19,112 @@ int packet_queue_init(packet_queue_t *q)
     return 0;
 }
 
+// 队列中packet的数量，生产者和消费者都可调用
+int packet_queue_nb_packets(packet_queue_t *q)
+{
+    return (int)((unsigned)SDL_AtomicGet(&q->windex) - (unsigned)SDL_AtomicGet(&q->rindex));
+}
+
+int packet_queue_size(packet_queue_t *q)
+{
+    return SDL_AtomicGet(&q->size);
+}
+
+// 队列满(生产者，for_put为1)或空(消费者，for_put为0)时等待对方唤醒。队列被中止时返回-1
+// 先置sleeping再检查队列，唤醒方先更新索引再检查sleeping，两者中至少一方能看到对方的修改，不会丢失唤醒
+static int packet_queue_wait(packet_queue_t *q, int for_put)
+{
+    int ret;
+
+    SDL_LockMutex(q->mutex);
+    SDL_AtomicSet(&q->sleeping, 1);
+    while (!q->abort_request &&
+           (for_put ? packet_queue_nb_packets(q) >= PKT_QUEUE_SIZE : packet_queue_nb_packets(q) == 0))
+    {
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    SDL_AtomicSet(&q->sleeping, 0);
+    ret = q->abort_request ? -1 : 0;
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
+
+// 读写索引更新后调用，只有对方在等待时才加锁
+static void packet_queue_wakeup(packet_queue_t *q)
+{
+    if (SDL_AtomicGet(&q->sleeping))
+    {
+        SDL_LockMutex(q->mutex);
+        SDL_CondSignal(q->cond);
+        SDL_UnlockMutex(q->mutex);
+    }
+}
 
-// 写队列尾部。pkt是一包还未解码的音频数据
+// 写队列尾部。pkt是一包还未解码的音频数据，其引用移入队列；失败时pkt被释放
+// 只能由生产者调用，队列满时阻塞
 int packet_queue_put(packet_queue_t *q, AVPacket *pkt)
 {
-    AVPacketList *pkt_list;
+    packet_slot_t *slot;
     
-    if (av_packet_make_refcounted(pkt) < 0)
+    // data为NULL的flush/null packet不含数据，不需要引用计数
+    if (pkt->data && av_packet_make_refcounted(pkt) < 0)
     {
         printf("[pkt] is not refrence counted\n");
+        av_packet_unref(pkt);
         return -1;
     }
-    pkt_list = av_malloc(sizeof(AVPacketList));
-    if (!pkt_list)
+    if (packet_queue_nb_packets(q) >= PKT_QUEUE_SIZE && packet_queue_wait(q, 1) < 0)
     {
+        av_packet_unref(pkt);
         return -1;
     }
-    
-    pkt_list->pkt = *pkt;
-    pkt_list->next = NULL;
-
-    SDL_LockMutex(q->mutex);
 
-    if (!q->last_pkt)   // 队列为空
-    {
-        q->first_pkt = pkt_list;
-    }
-    else
-    {
-        q->last_pkt->next = pkt_list;
-    }
-    q->last_pkt = pkt_list;
-    q->nb_packets++;
-    q->size += pkt_list->pkt.size;
-    // 发个条件变量的信号：重启等待q->cond条件变量的一个线程
-    SDL_CondSignal(q->cond);
+    slot = &q->slots[SDL_AtomicGet(&q->windex) & (PKT_QUEUE_SIZE - 1)];
+    av_packet_move_ref(&slot->pkt, pkt);
+    slot->serial = q->serial;
+    SDL_AtomicAdd(&q->size, slot->pkt.size);
+    // 写索引加1后消费者才能看到此槽
+    SDL_AtomicAdd(&q->windex, 1);
+    packet_queue_wakeup(q);
 
-    SDL_UnlockMutex(q->mutex);
     return 0;
 }
 
-// 读队列头部。
-int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int block)
+// 读队列头部。serial可为NULL，否则返回packet写入时的播放序列
+// 只能由消费者调用。返回1表示取到packet，返回0表示队列空且不阻塞，返回-1表示队列已中止
+int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int block, int *serial)
 {
-    AVPacketList *p_pkt_node;
-    int ret;
-
-    SDL_LockMutex(q->mutex);
+    packet_slot_t *slot;
 
-    while (1)
+    if (q->abort_request)
     {
-        p_pkt_node = q->first_pkt;
-        if (p_pkt_node)             // 队列非空，取一个出来
-        {
-            q->first_pkt = p_pkt_node->next;
-            if (!q->first_pkt)
-            {
-                q->last_pkt = NULL;
-            }
-            q->nb_packets--;
-            q->size -= p_pkt_node->pkt.size;
-            *pkt = p_pkt_node->pkt;
-            av_free(p_pkt_node);
-            ret = 1;
-            break;
-        }
-        else if (!block)            // 队列空且阻塞标志无效，则立即退出
+        return -1;
+    }
+    if (packet_queue_nb_packets(q) == 0)
+    {
+        if (!block)                 // 队列空且阻塞标志无效，则立即退出
         {
-            ret = 0;
-            break;
+            return 0;
         }
-        else                        // 队列空且阻塞标志有效，则等待
+        if (packet_queue_wait(q, 0) < 0)
         {
-            SDL_CondWait(q->cond, q->mutex);
+            return -1;
         }
     }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
+
+    slot = &q->slots[SDL_AtomicGet(&q->rindex) & (PKT_QUEUE_SIZE - 1)];
+    av_packet_move_ref(pkt, &slot->pkt);
+    if (serial)
+    {
+        *serial = slot->serial;
+    }
+    SDL_AtomicAdd(&q->size, -pkt->size);
+    // 读索引加1后此槽可被生产者复用
+    SDL_AtomicAdd(&q->rindex, 1);
+    packet_queue_wakeup(q);
+
+    return 1;
 }
 
 int packet_queue_put_nullpacket(packet_queue_t *q, int stream_index)
@@ -108,22 +137,31 @@ int packet_queue_put_nullpacket(packet_queue_t *q, int stream_index)
     return packet_queue_put(q, pkt);
 }
 
+// 开始新的播放序列(seek)：serial加1后写入flush packet，只能由生产者调用
+// 队列中已有的packet不在此释放，消费者取出后发现其播放序列已过期，直接丢弃
+int packet_queue_put_flushpacket(packet_queue_t *q)
+{
+    AVPacket pkt1, *pkt = &pkt1;
+    av_init_packet(pkt);
+    pkt->data = NULL;
+    pkt->size = 0;
+    q->serial++;
+    return packet_queue_put(q, pkt);
+}
+
+// 释放队列中所有packet，只能在生产者和消费者线程都已退出后调用
 void packet_queue_flush(packet_queue_t *q)
 {
-    AVPacketList *pkt, *pkt1;
+    unsigned w = (unsigned)SDL_AtomicGet(&q->windex);
+    unsigned r;
 
-    SDL_LockMutex(q->mutex);
-    for (pkt = q->first_pkt; pkt; pkt = pkt1) {
-        pkt1 = pkt->next;
-        av_packet_unref(&pkt->pkt);
-        av_freep(&pkt);
+    for (r = (unsigned)SDL_AtomicGet(&q->rindex); r != w; r++)
+    {
+        av_packet_unref(&q->slots[r & (PKT_QUEUE_SIZE - 1)].pkt);
     }
-    q->last_pkt = NULL;
-    q->first_pkt = NULL;
-    q->nb_packets = 0;
-    q->size = 0;
+    SDL_AtomicSet(&q->rindex, (int)w);
+    SDL_AtomicSet(&q->size, 0);
     q->duration = 0;
-    SDL_UnlockMutex(q->mutex);
 }
 
 void packet_queue_destroy(packet_queue_t *q)
@@ -139,8 +177,7 @@ void packet_queue_abort(packet_queue_t *q)
 
     q->abort_request = 1;
 
-    SDL_CondSignal(q->cond);
+    SDL_CondBroadcast(q->cond);
 
     SDL_UnlockMutex(q->mutex);
 }
-
@@ -5,8 +5,11 @@
 
 int packet_queue_init(packet_queue_t *q);
 int packet_queue_put(packet_queue_t *q, AVPacket *pkt);
-int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int block);
+int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int block, int *serial);
+int packet_queue_nb_packets(packet_queue_t *q);
+int packet_queue_size(packet_queue_t *q);
 int packet_queue_put_nullpacket(packet_queue_t *q, int stream_index);
+int packet_queue_put_flushpacket(packet_queue_t *q);
 void packet_queue_destroy(packet_queue_t *q);
 void packet_queue_abort(packet_queue_t *q);
 
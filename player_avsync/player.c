@@ -24,10 +24,11 @@
 #include "frame.h"
 #include "packet.h"
 #include "demux.h"
+#include "keyindex.h"
 #include "video.h"
 #include "audio.h"
 
-static player_stat_t *player_init(const char *p_input_file);
+static player_stat_t *player_init(const char *p_input_file, int use_mmap, int use_keyindex, int use_vsync);
 static int player_deinit(player_stat_t *is);
 
 // 返回值：返回上一帧的pts更新值(上一帧pts+流逝的时间)
@@ -104,7 +105,7 @@ static void do_exit(player_stat_t *is)
     exit(0);
 }
 
-static player_stat_t *player_init(const char *p_input_file)
+static player_stat_t *player_init(const char *p_input_file, int use_mmap, int use_keyindex, int use_vsync)
 {
     player_stat_t *is;
 
@@ -119,6 +120,9 @@ static player_stat_t *player_init(const char *p_input_file)
     {
         goto fail;
     }
+    is->use_mmap = use_mmap;
+    is->use_keyindex = use_keyindex;
+    is->use_vsync = use_vsync;
 
     /* start video display */
     if (frame_queue_init(&is->video_frm_queue, &is->video_pkt_queue, VIDEO_PICTURE_QUEUE_SIZE, 1) < 0 ||
@@ -134,7 +138,9 @@ static player_stat_t *player_init(const char *p_input_file)
     }
 
     AVPacket flush_pkt;
+    av_init_packet(&flush_pkt);
     flush_pkt.data = NULL;
+    flush_pkt.size = 0;
     packet_queue_put(&is->video_pkt_queue, &flush_pkt);
     packet_queue_put(&is->audio_pkt_queue, &flush_pkt);
 
@@ -146,6 +152,8 @@ fail:
         goto fail;
     }
 
+    is->video_pkt_serial = -1;
+    is->audio_pkt_serial = -1;
     init_clock(&is->video_clk, &is->video_pkt_queue.serial);
     init_clock(&is->audio_clk, &is->audio_pkt_queue.serial);
 
@@ -167,6 +175,7 @@ static int player_deinit(player_stat_t *is)
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
     SDL_WaitThread(is->read_tid, NULL);
+    keyframe_index_stop(&is->keyindex);
 
     /* close each stream */
     if (is->audio_idx >= 0)
@@ -178,7 +187,7 @@ static int player_deinit(player_stat_t *is)
         //stream_component_close(is, is->p_video_stream);
     }
 
-    avformat_close_input(&is->p_fmt_ctx);
+    avio_mmap_close_input(&is->p_fmt_ctx);
 
     packet_queue_abort(&is->video_pkt_queue);
     packet_queue_abort(&is->audio_pkt_queue);
@@ -191,6 +200,7 @@ static int player_deinit(player_stat_t *is)
 
     SDL_DestroyCond(is->continue_read_thread);
     sws_freeContext(is->img_convert_ctx);
+    av_frame_free(&is->p_frm_yuv);
     av_free(is->filename);
     if (is->sdl_video.texture)
     {
@@ -203,7 +213,7 @@ static int player_deinit(player_stat_t *is)
 }
 
 /* pause or resume the video */
-static void stream_toggle_pause(player_stat_t *is)
+void stream_toggle_pause(player_stat_t *is)
 {
     if (is->paused)
     {
@@ -220,11 +230,118 @@ static void toggle_pause(player_stat_t *is)
     is->step = 0;
 }
 
-int player_running(const char *p_input_file)
+// 暂停状态下播放一帧后再暂停，由video_refresh()在显示一帧后恢复暂停
+void step_to_next_frame(player_stat_t *is)
+{
+    /* if the stream is paused unpause it, then step */
+    if (is->paused)
+    {
+        stream_toggle_pause(is);
+    }
+    is->step = 1;
+    // 暂停时主线程无限期等待事件，由seek所在的解复用线程调用时须唤醒
+    video_refresh_wakeup(is);
+}
+
+// 请求seek，由解复用线程执行。pos是目标位置，rel是相对当前位置的增量，单位都是AV_TIME_BASE
+// 上一次请求尚未执行时忽略本次请求
+void player_seek(player_stat_t *is, int64_t pos, int64_t rel)
+{
+    if (!is->seek_req)
+    {
+        is->seek_pos = pos;
+        is->seek_rel = rel;
+        is->seek_req = 1;
+        SDL_CondSignal(is->continue_read_thread);
+    }
+}
+
+// 从当前播放位置(音频时钟，无音频时用视频时钟)前后seek incr秒
+static void seek_by(player_stat_t *is, double incr)
+{
+    double pos = get_clock(&is->audio_clk);
+    int64_t start_time = is->p_fmt_ctx->start_time;
+
+    if (isnan(pos))
+    {
+        pos = get_clock(&is->video_clk);
+    }
+    if (isnan(pos))
+    {
+        pos = (double)is->seek_pos / AV_TIME_BASE;
+    }
+    pos += incr;
+    if (start_time != AV_NOPTS_VALUE && pos < start_time / (double)AV_TIME_BASE)
+    {
+        pos = start_time / (double)AV_TIME_BASE;
+    }
+    player_seek(is, (int64_t)(pos * AV_TIME_BASE), (int64_t)(incr * AV_TIME_BASE));
+}
+
+// 等待下一个SDL事件，等待期间在当前帧的播放时刻显示视频帧
+// 1. 刷新视频，得到距下一帧播放时刻的时间。没有待显示的帧或处于暂停状态时为无穷大
+// 2. 无穷大则无限期等待事件，新帧由视频解码线程通过FF_REFRESH_EVENT通知
+// 3. 否则等待事件直到播放时刻。SDL_WaitEventTimeout()精度为毫秒且旧版本按10毫秒轮询，提前REFRESH_WAIT_MARGIN毫秒超时，剩余部分用av_usleep()补齐
+// 收到FF_REFRESH_EVENT回到1，其他事件返回由调用者处理
+static void refresh_loop_wait_event(player_stat_t *is, SDL_Event *event)
+{
+    double remaining_time;
+    double target;
+    int timeout;
+
+    while (1)
+    {
+        // 1
+        remaining_time = INFINITY;
+        if (is->video_idx >= 0)
+        {
+            video_refresh(is, &remaining_time);
+        }
+
+        if (isinf(remaining_time))
+        {
+            // 2. 先置等待标志再检查队列，避免错过检查之后写入的帧
+            SDL_AtomicSet(&is->refresh_idle, 1);
+            if (is->video_idx >= 0 && !is->paused && frame_queue_nb_remaining(&is->video_frm_queue) > 0)
+            {
+                // 刚显示了一帧，计算下一帧的播放时刻
+                SDL_AtomicSet(&is->refresh_idle, 0);
+                continue;
+            }
+            if (!SDL_WaitEvent(event))
+            {
+                continue;
+            }
+            SDL_AtomicSet(&is->refresh_idle, 0);
+        }
+        else
+        {
+            // 3
+            target = av_gettime_relative() / 1000000.0 + remaining_time;
+            timeout = (int)(remaining_time * 1000.0) - REFRESH_WAIT_MARGIN;
+            if (timeout <= 0 || !SDL_WaitEventTimeout(event, timeout))
+            {
+                remaining_time = target - av_gettime_relative() / 1000000.0;
+                if (remaining_time > 0.0)
+                {
+                    av_usleep((unsigned)(remaining_time * 1000000.0));
+                }
+                continue;
+            }
+        }
+
+        if (event->type != FF_REFRESH_EVENT)
+        {
+            return;
+        }
+    }
+}
+
+int player_running(const char *p_input_file, int use_mmap, int use_keyindex, int use_vsync)
 {
     player_stat_t *is = NULL;
 
-    is = player_init(p_input_file);
+    is = player_init(p_input_file, use_mmap, use_keyindex, use_vsync);
     if (is == NULL)
     {
         printf("player init failed\n");
@@ -239,13 +356,8 @@ int player_running(const char *p_input_file)
 
     while (1)
     {
-        SDL_PumpEvents();
-        // SDL event队列为空，则在while循环中播放视频帧。否则从队列头部取一个event，退出当前函数，在上级函数中处理event
-        while (!SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT))
-        {
-            av_usleep(100000);
-            SDL_PumpEvents();
-        }
+        // 等待事件期间按播放时刻显示视频帧
+        refresh_loop_wait_event(is, &event);
 
         switch (event.type) {
         case SDL_KEYDOWN:
@@ -259,6 +371,18 @@ int player_running(const char *p_input_file)
             case SDLK_SPACE:        // 空格键：暂停
                 toggle_pause(is);
                 break;
+            case SDLK_LEFT:         // 左右键：后退/前进10秒
+                seek_by(is, -SEEK_STEP_SHORT);
+                break;
+            case SDLK_RIGHT:
+                seek_by(is, SEEK_STEP_SHORT);
+                break;
+            case SDLK_DOWN:         // 下上键：后退/前进1分钟
+                seek_by(is, -SEEK_STEP_LONG);
+                break;
+            case SDLK_UP:
+                seek_by(is, SEEK_STEP_LONG);
+                break;
             case SDL_WINDOWEVENT:
                 break;
             default:
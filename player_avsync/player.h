@@ -12,6 +12,7 @@
 #include <libavutil/frame.h>
 #include <libavutil/time.h>
 #include <libavutil/imgutils.h>
+#include "avio_mmap.h"
 #if defined(_WIN32)
 #include <SDL.h>
 #include <SDL_video.h>
@@ -35,14 +36,13 @@
 /* no AV correction is done if too big error */
 #define AV_NOSYNC_THRESHOLD 10.0
 
-/* polls for possible required screen refresh at least this often, should be less than 1/fps */
-#define REFRESH_RATE 0.01
-
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000
 
 #define MAX_QUEUE_SIZE (15 * 1024 * 1024)
 #define MIN_FRAMES 25
+/* packet队列的槽数，必须是2的幂。解复用线程按MAX_QUEUE_SIZE、MIN_FRAMES控制读取，一般不会写满 */
+#define PKT_QUEUE_SIZE 1024
 
 /* Minimum SDL audio buffer size, in samples. */
 #define SDL_AUDIO_MIN_BUFFER_SIZE 512
@@ -55,8 +55,22 @@
 #define FRAME_QUEUE_SIZE FFMAX(SAMPLE_QUEUE_SIZE, FFMAX(VIDEO_PICTURE_QUEUE_SIZE, SUBPICTURE_QUEUE_SIZE))
 
 
+/* the refresh loop leaves SDL_WaitEventTimeout() this many ms before a frame is due and sleeps the rest,
+   before SDL 2.0.16 it polls in 10 ms steps and may return up to 10 ms late */
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+#define REFRESH_WAIT_MARGIN 1
+#else
+#define REFRESH_WAIT_MARGIN 10
+#endif
+
+/* wakes the refresh loop in the main thread when it waits for a picture */
+#define FF_REFRESH_EVENT (SDL_USEREVENT + 1)
 #define FF_QUIT_EVENT    (SDL_USEREVENT + 2)
 
+/* seek step of the arrow keys, in seconds */
+#define SEEK_STEP_SHORT 10.0
+#define SEEK_STEP_LONG 60.0
+
 typedef struct {
     double pts;                     // 当前帧(待播放)显示时间戳，播放后，当前帧变成上一帧
     double pts_drift;               // 当前帧显示时间戳与当前系统时钟时间的差值
@@ -83,17 +97,43 @@ typedef struct {
     SDL_Rect rect;
 }   sdl_video_t;
 
+typedef struct {
+    AVPacket pkt;
+    int serial;                     // 写入时队列的播放序列
+}   packet_slot_t;
+
+// 单生产者(解复用线程)、单消费者(解码线程)的环形队列。packet直接存放在槽中，不再为每个packet分配节点；
+// 读写索引用原子变量，只有队列空或满时才加锁等待
 typedef struct packet_queue_t {
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;                 // 队列中packet的数量
-    int size;                       // 队列所占内存空间大小
+    packet_slot_t slots[PKT_QUEUE_SIZE];
+    SDL_atomic_t windex;            // 已写入的packet总数，只由生产者修改
+    SDL_atomic_t rindex;            // 已读出的packet总数，只由消费者修改，两者之差为队列中packet的数量
+    SDL_atomic_t size;              // 队列所占内存空间大小
     int64_t duration;               // 队列中所有packet总的播放时长
     int abort_request;
     int serial;                     // 播放序列，所谓播放序列就是一段连续的播放动作，一个seek操作会启动一段新的播放序列
-    SDL_mutex *mutex;
+    SDL_atomic_t sleeping;          // 有线程因队列空或满在cond上等待
+    SDL_mutex *mutex;               // 只用于等待和唤醒，读写packet不加锁
     SDL_cond *cond;
 }   packet_queue_t;
 
+typedef struct {
+    int64_t ts;                     // 关键帧时间戳，单位AV_TIME_BASE
+    int64_t pos;                    // 关键帧packet在输入文件中的字节偏移
+}   keyframe_entry_t;
+
+// 关键帧索引：播放期间由后台线程用另一个AVFormatContext顺序扫描输入文件(只读packet，不解码)建立，
+// seek时在已扫描的范围内直接按字节偏移定位，不必由解复用器按时间戳二分查找
+typedef struct {
+    keyframe_entry_t *entries;      // 按ts递增
+    int nb_entries;
+    int capacity;
+    int complete;                   // 已扫描到文件末尾
+    int abort_request;
+    SDL_mutex *mutex;               // 保护entries、nb_entries、complete
+    SDL_Thread *tid;
+}   keyframe_index_t;
+
 /* Common struct for handling all types of decoded data and allocated render buffers. */
 typedef struct {
     AVFrame *frame;
@@ -109,21 +149,27 @@ typedef struct {
     int flip_v;
 }   frame_t;
 
+// 单生产者(解码线程)、单消费者(视频刷新或音频回调)的帧队列。读写索引各自只由一方修改，
+// 帧数用原子变量计数，读取一方从不加锁也不等待；只有队列满时写入一方才在cond上等待
 typedef struct {
     frame_t queue[FRAME_QUEUE_SIZE];
-    int rindex;                     // 读索引。待播放时读取此帧进行播放，播放后此帧成为上一帧
-    int windex;                     // 写索引
-    int size;                       // 总帧数
+    int rindex;                     // 读索引。待播放时读取此帧进行播放，播放后此帧成为上一帧。只由消费者修改
+    int windex;                     // 写索引。只由生产者修改
+    SDL_atomic_t size;              // 总帧数
     int max_size;                   // 队列可存储最大帧数
     int keep_last;
-    int rindex_shown;               // 当前是否有帧在显示
-    SDL_mutex *mutex;
+    int rindex_shown;               // 当前是否有帧在显示。只由消费者修改
+    SDL_atomic_t sleeping;          // 生产者因队列满在cond上等待
+    SDL_mutex *mutex;               // 只用于生产者等待和唤醒
     SDL_cond *cond;
     packet_queue_t *pktq;           // 指向对应的packet_queue
 }   frame_queue_t;
 
 typedef struct {
     char *filename;
+    int use_mmap;                   // 本地文件通过mmap读取
+    int use_keyindex;               // 后台建立关键帧索引，seek时按字节偏移定位
+    int use_vsync;                  // 渲染器开启垂直同步，画面在显示器刷新时更新
     AVFormatContext *p_fmt_ctx;
     AVStream *p_audio_stream;
     AVStream *p_video_stream;
@@ -137,15 +183,18 @@ typedef struct {
     play_clock_t audio_clk;                   // 音频时钟
     play_clock_t video_clk;                   // 视频时钟
     double frame_timer;
+    SDL_atomic_t refresh_idle;      // 主线程没有可显示的帧、无限期等待事件时为1，此时写入新帧需发送FF_REFRESH_EVENT唤醒
 
     packet_queue_t audio_pkt_queue;
     packet_queue_t video_pkt_queue;
+    int audio_pkt_serial;           // 音频解码器当前解码的packet的播放序列
+    int video_pkt_serial;           // 视频解码器当前解码的packet的播放序列
     frame_queue_t audio_frm_queue;
     frame_queue_t video_frm_queue;
 
-    struct SwsContext *img_convert_ctx;
+    struct SwsContext *img_convert_ctx;     // 仅用于SDL不支持的像素格式，转换为YUV420P
     struct SwrContext *audio_swr_ctx;
-    AVFrame *p_frm_yuv;
+    AVFrame *p_frm_yuv;                     // 上述转换的输出
 
     audio_param_t audio_param_src;
     audio_param_t audio_param_tgt;
@@ -162,13 +211,22 @@ typedef struct {
     int abort_request;
     int paused;
     int step;
+    int eof;                        // 输入文件已读完，已向解码器发送null packet
+
+    int seek_req;                   // 由主线程置位，解复用线程执行seek后清零
+    int64_t seek_pos;               // seek目标，单位AV_TIME_BASE
+    int64_t seek_rel;               // 相对seek的增量，向前为正，用于限定可接受的关键帧范围
+    keyframe_index_t keyindex;
 
     SDL_cond *continue_read_thread;
     SDL_Thread *read_tid;           // demux解复用线程
 
 }   player_stat_t;
 
-int player_running(const char *p_input_file);
+int player_running(const char *p_input_file, int use_mmap, int use_keyindex, int use_vsync);
+void player_seek(player_stat_t *is, int64_t pos, int64_t rel);
+void stream_toggle_pause(player_stat_t *is);
+void step_to_next_frame(player_stat_t *is);
 double get_clock(play_clock_t *c);
 void set_clock_at(play_clock_t *c, double pts, int serial, double time);
 void set_clock(play_clock_t *c, double pts, int serial);
@@ -3,7 +3,7 @@
 #include "frame.h"
 #include "player.h"
 
-static int queue_picture(player_stat_t *is, AVFrame *src_frame, double pts, double duration, int64_t pos)
+static int queue_picture(player_stat_t *is, AVFrame *src_frame, double pts, double duration, int64_t pos, int serial)
 {
     frame_t *vp;
 
@@ -20,7 +20,7 @@ static int queue_picture(player_stat_t *is, AVFrame *src_frame, double pts, doub
     vp->pts = pts;
     vp->duration = duration;
     vp->pos = pos;
-    //vp->serial = serial;
+    vp->serial = serial;
 
     //set_default_window_size(vp->width, vp->height, vp->sar);
 
@@ -28,12 +28,27 @@ static int queue_picture(player_stat_t *is, AVFrame *src_frame, double pts, doub
     av_frame_move_ref(vp->frame, src_frame);
     // 更新队列计数及写索引
     frame_queue_push(&is->video_frm_queue);
+    // 主线程在等待新帧，唤醒之
+    if (SDL_AtomicSet(&is->refresh_idle, 0))
+    {
+        video_refresh_wakeup(is);
+    }
     return 0;
 }
 
+// 唤醒主线程的刷新循环重新计算下一帧的播放时刻，可在任意线程调用
+void video_refresh_wakeup(player_stat_t *is)
+{
+    SDL_Event event;
 
-// 从packet_queue中取一个packet，解码生成frame
-static int video_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt_queue, AVFrame *frame)
+    event.type = FF_REFRESH_EVENT;
+    event.user.data1 = is;
+    SDL_PushEvent(&event);
+}
+
+
+// 从packet_queue中取一个packet，解码生成frame。pkt_serial是解码器当前解码的packet的播放序列
+static int video_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt_queue, int *pkt_serial, AVFrame *frame)
 {
     int ret;
     
@@ -46,6 +61,12 @@ static int video_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt
             //if (d->queue->abort_request)
             //    return -1;
 
+            // 已seek，解码器中的帧属于过期的播放序列，不再接收
+            if (*pkt_serial != p_pkt_queue->serial)
+            {
+                break;
+            }
+
             // 3. 从解码器接收frame
             // 3.1 一个视频packet含一个视频frame
             //     解码器缓存一定数量的packet后，才有解码后的frame输出
@@ -81,11 +102,18 @@ static int video_decode_frame(AVCodecContext *p_codec_ctx, packet_queue_t *p_pkt
             }
         }
 
-        // 1. 取出一个packet。使用pkt对应的serial赋值给d->pkt_serial
-        if (packet_queue_get(p_pkt_queue, &pkt, true) < 0)
+        // 1. 取出一个packet。使用pkt对应的serial赋值给d->pkt_serial，seek之前写入的packet直接丢弃
+        do
         {
-            return -1;
-        }
+            if (packet_queue_get(p_pkt_queue, &pkt, true, pkt_serial) < 0)
+            {
+                return -1;
+            }
+            if (*pkt_serial != p_pkt_queue->serial)
+            {
+                av_packet_unref(&pkt);
+            }
+        } while (*pkt_serial != p_pkt_queue->serial);
 
         // packet_queue中第一个总是flush_pkt。每次seek操作会插入flush_pkt，更新serial，开启新的播放序列
         if (pkt.data == NULL)
@@ -128,7 +156,7 @@ static int video_decode_thread(void *arg)
 
     while (1)
     {
-        got_picture = video_decode_frame(is->p_vcodec_ctx, &is->video_pkt_queue, p_frame);
+        got_picture = video_decode_frame(is->p_vcodec_ctx, &is->video_pkt_queue, &is->video_pkt_serial, p_frame);
         if (got_picture < 0)
         {
             goto exit;
@@ -136,7 +164,7 @@ static int video_decode_thread(void *arg)
         
         duration = (frame_rate.num && frame_rate.den ? av_q2d((AVRational){frame_rate.den, frame_rate.num}) : 0);   // 当前帧播放时长
         pts = (p_frame->pts == AV_NOPTS_VALUE) ? NAN : p_frame->pts * av_q2d(tb);   // 当前帧显示时间戳
-        ret = queue_picture(is, p_frame, pts, duration, p_frame->pkt_pos);   // 将当前帧压入frame_queue
+        ret = queue_picture(is, p_frame, pts, duration, p_frame->pkt_pos, is->video_pkt_serial);   // 将当前帧压入frame_queue
         av_frame_unref(p_frame);
 
         if (ret < 0)
@@ -209,38 +237,183 @@ static void update_video_pts(player_stat_t *is, double pts, int64_t pos, int ser
     //-sync_clock_to_slave(&is->extclk, &is->vidclk);  // 将extclock同步到vidclock
 }
 
-static void video_display(player_stat_t *is)
+// 解码帧格式与SDL纹理格式的对应关系，这些格式的帧不做任何转换，直接从AVFrame的各plane上传到纹理
+static const struct {
+    enum AVPixelFormat format;
+    Uint32 texture_fmt;
+} sdl_texture_format_map[] = {
+    { AV_PIX_FMT_RGB8,           SDL_PIXELFORMAT_RGB332 },
+    { AV_PIX_FMT_RGB444,         SDL_PIXELFORMAT_RGB444 },
+    { AV_PIX_FMT_RGB555,         SDL_PIXELFORMAT_RGB555 },
+    { AV_PIX_FMT_BGR555,         SDL_PIXELFORMAT_BGR555 },
+    { AV_PIX_FMT_RGB565,         SDL_PIXELFORMAT_RGB565 },
+    { AV_PIX_FMT_BGR565,         SDL_PIXELFORMAT_BGR565 },
+    { AV_PIX_FMT_RGB24,          SDL_PIXELFORMAT_RGB24 },
+    { AV_PIX_FMT_BGR24,          SDL_PIXELFORMAT_BGR24 },
+    { AV_PIX_FMT_0RGB32,         SDL_PIXELFORMAT_RGB888 },
+    { AV_PIX_FMT_0BGR32,         SDL_PIXELFORMAT_BGR888 },
+    { AV_PIX_FMT_NE(RGB0, 0BGR), SDL_PIXELFORMAT_RGBX8888 },
+    { AV_PIX_FMT_NE(BGR0, 0RGB), SDL_PIXELFORMAT_BGRX8888 },
+    { AV_PIX_FMT_RGB32,          SDL_PIXELFORMAT_ARGB8888 },
+    { AV_PIX_FMT_RGB32_1,        SDL_PIXELFORMAT_RGBA8888 },
+    { AV_PIX_FMT_BGR32,          SDL_PIXELFORMAT_ABGR8888 },
+    { AV_PIX_FMT_BGR32_1,        SDL_PIXELFORMAT_BGRA8888 },
+    { AV_PIX_FMT_YUV420P,        SDL_PIXELFORMAT_IYUV },
+    { AV_PIX_FMT_YUYV422,        SDL_PIXELFORMAT_YUY2 },
+    { AV_PIX_FMT_UYVY422,        SDL_PIXELFORMAT_UYVY },
+    { AV_PIX_FMT_NV12,           SDL_PIXELFORMAT_NV12 },
+    { AV_PIX_FMT_NV21,           SDL_PIXELFORMAT_NV21 },
+};
+
+// 返回解码帧格式对应的SDL纹理格式，没有对应格式或图像倒置存储(linesize为负)时返回SDL_PIXELFORMAT_UNKNOWN
+static Uint32 get_texture_format(const AVFrame *frame)
 {
-    frame_t *vp;
+    int i;
 
-    vp = frame_queue_peek_last(&is->video_frm_queue);
+    if (frame->linesize[0] <= 0 || frame->linesize[1] < 0 || frame->linesize[2] < 0)
+    {
+        return SDL_PIXELFORMAT_UNKNOWN;
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(sdl_texture_format_map); i++)
+    {
+        if (frame->format == sdl_texture_format_map[i].format)
+        {
+            return sdl_texture_format_map[i].texture_fmt;
+        }
+    }
+    return SDL_PIXELFORMAT_UNKNOWN;
+}
+
+// 纹理不存在或其格式、尺寸与待上传的图像不一致时，重新创建纹理
+static int realloc_texture(sdl_video_t *sdl_video, Uint32 texture_fmt, int width, int height)
+{
+    Uint32 format;
+    int access, w, h;
 
-    // 图像转换：p_frm_raw->data ==> p_frm_yuv->data
+    if (sdl_video->texture &&
+        SDL_QueryTexture(sdl_video->texture, &format, &access, &w, &h) == 0 &&
+        format == texture_fmt && w == width && h == height)
+    {
+        return 0;
+    }
+    if (sdl_video->texture)
+    {
+        SDL_DestroyTexture(sdl_video->texture);
+    }
+    // 一个SDL_Texture对应一帧图像数据，同SDL 1.x中的SDL_Overlay
+    sdl_video->texture = SDL_CreateTexture(sdl_video->renderer, texture_fmt, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (sdl_video->texture == NULL)
+    {
+        printf("SDL_CreateTexture() failed: %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+// NV12/NV21：SDL_UpdateNVTexture()要求SDL 2.0.16以上，这里锁定纹理后逐行拷贝Y plane和UV plane
+static int upload_nv_texture(SDL_Texture *texture, const AVFrame *frame)
+{
+    uint8_t *pixels;
+    int pitch;
+
+    if (SDL_LockTexture(texture, NULL, (void **)&pixels, &pitch) < 0)
+    {
+        return -1;
+    }
+    av_image_copy_plane(pixels, pitch, frame->data[0], frame->linesize[0], frame->width, frame->height);
+    av_image_copy_plane(pixels + pitch * frame->height, pitch, frame->data[1], frame->linesize[1],
+                        (frame->width + 1) & ~1, (frame->height + 1) >> 1);
+    SDL_UnlockTexture(texture);
+    return 0;
+}
+
+// 将一帧图像上传到纹理
+// 1. SDL支持解码帧的格式：按此格式创建纹理，直接从AVFrame的各plane上传，不做转换
+// 2. 其他格式：用缓存的SwsContext转换为YUV420P后上传，帧格式和尺寸不变时复用SwsContext和转换缓冲区
+static int upload_texture(player_stat_t *is, AVFrame *frame)
+{
+    Uint32 texture_fmt = get_texture_format(frame);
+    AVFrame *yuv = is->p_frm_yuv;
+    int ret;
+
+    // 1
+    if (texture_fmt != SDL_PIXELFORMAT_UNKNOWN)
+    {
+        if (realloc_texture(&is->sdl_video, texture_fmt, frame->width, frame->height) < 0)
+        {
+            return -1;
+        }
+        switch (texture_fmt)
+        {
+        case SDL_PIXELFORMAT_IYUV:
+            return SDL_UpdateYUVTexture(is->sdl_video.texture, NULL,
+                                        frame->data[0], frame->linesize[0],     // y plane, y pitch
+                                        frame->data[1], frame->linesize[1],     // u plane, u pitch
+                                        frame->data[2], frame->linesize[2]);    // v plane, v pitch
+        case SDL_PIXELFORMAT_NV12:
+        case SDL_PIXELFORMAT_NV21:
+            return upload_nv_texture(is->sdl_video.texture, frame);
+        default:
+            // packed格式只有一个plane
+            return SDL_UpdateTexture(is->sdl_video.texture, NULL, frame->data[0], frame->linesize[0]);
+        }
+    }
+
+    // 2
+    // 图像转换：frame->data ==> p_frm_yuv->data
     // 将源图像中一片连续的区域经过处理后更新到目标图像对应区域，处理的图像区域必须逐行连续
     // plane: 如YUV有Y、U、V三个plane，RGB有R、G、B三个plane
     // slice: 图像中一片连续的行，必须是连续的，顺序由顶部到底部或由底部到顶部
     // stride/pitch: 一行图像所占的字节数，Stride=BytesPerPixel*Width+Padding，注意对齐
-    // AVFrame.*data[]: 每个数组元素指向对应plane
-    // AVFrame.linesize[]: 每个数组元素表示对应plane中一行图像所占的字节数
-    sws_scale(is->img_convert_ctx,                      // sws context
-              (const uint8_t *const *)vp->frame->data,// src slice
-              vp->frame->linesize,                    // src stride
-              0,                                      // src slice y
-              is->p_vcodec_ctx->height,               // src slice height
-              is->p_frm_yuv->data,                    // dst planes
-              is->p_frm_yuv->linesize                 // dst strides
-             );
-    
-    // 使用新的YUV像素数据更新SDL_Rect
-    SDL_UpdateYUVTexture(is->sdl_video.texture,         // sdl texture
-                         &is->sdl_video.rect,           // sdl rect
-                         is->p_frm_yuv->data[0],        // y plane
-                         is->p_frm_yuv->linesize[0],    // y pitch
-                         is->p_frm_yuv->data[1],        // u plane
-                         is->p_frm_yuv->linesize[1],    // u pitch
-                         is->p_frm_yuv->data[2],        // v plane
-                         is->p_frm_yuv->linesize[2]     // v pitch
-                        );
+    is->img_convert_ctx = sws_getCachedContext(is->img_convert_ctx,
+                                               frame->width, frame->height, frame->format,
+                                               frame->width, frame->height, AV_PIX_FMT_YUV420P,
+                                               SWS_BICUBIC, NULL, NULL, NULL);
+    if (is->img_convert_ctx == NULL)
+    {
+        printf("sws_getCachedContext() failed\n");
+        return -1;
+    }
+    if (yuv->width != frame->width || yuv->height != frame->height)
+    {
+        av_frame_unref(yuv);
+        yuv->format = AV_PIX_FMT_YUV420P;
+        yuv->width = frame->width;
+        yuv->height = frame->height;
+        if ((ret = av_frame_get_buffer(yuv, 1)) < 0)
+        {
+            printf("av_frame_get_buffer() failed %d\n", ret);
+            return ret;
+        }
+    }
+    sws_scale(is->img_convert_ctx,
+              (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height,
+              yuv->data, yuv->linesize);
+    if (realloc_texture(&is->sdl_video, SDL_PIXELFORMAT_IYUV, yuv->width, yuv->height) < 0)
+    {
+        return -1;
+    }
+    return SDL_UpdateYUVTexture(is->sdl_video.texture, NULL,
+                                yuv->data[0], yuv->linesize[0],
+                                yuv->data[1], yuv->linesize[1],
+                                yuv->data[2], yuv->linesize[2]);
+}
+
+static void video_display(player_stat_t *is)
+{
+    frame_t *vp;
+
+    vp = frame_queue_peek_last(&is->video_frm_queue);
+
+    // 同一帧只上传一次(暂停时反复显示上一帧)
+    if (!vp->uploaded)
+    {
+        if (upload_texture(is, vp->frame) < 0)
+        {
+            return;
+        }
+        vp->uploaded = 1;
+    }
     
     // 使用特定颜色清空当前渲染目标
     SDL_RenderClear(is->sdl_video.renderer);
@@ -256,9 +429,10 @@ static void video_display(player_stat_t *is)
 }
 
 /* called to display each frame */
-static void video_refresh(void *opaque, double *remaining_time)
+// 在主线程中调用。当前帧播放时刻未到时，将remaining_time更新为距其播放时刻的时间；
+// 显示了一帧、没有待显示的帧或处于暂停状态时，remaining_time保持不变
+void video_refresh(player_stat_t *is, double *remaining_time)
 {
-    player_stat_t *is = (player_stat_t *)opaque;
     double time;
     static bool first_frame = true;
 
@@ -276,8 +450,15 @@ retry:
     lastvp = frame_queue_peek_last(&is->video_frm_queue);     // 上一帧：上次已显示的帧
     vp = frame_queue_peek(&is->video_frm_queue);              // 当前帧：当前待显示的帧
 
+    // seek之前解码的帧，丢弃
+    if (vp->serial != is->video_pkt_queue.serial)
+    {
+        frame_queue_next(&is->video_frm_queue);
+        goto retry;
+    }
+
     // lastvp和vp不是同一播放序列(一个seek会开始一个新播放序列)，将frame_timer更新为当前时间
-    if (first_frame)
+    if (first_frame || lastvp->serial != vp->serial)
     {
         is->frame_timer = av_gettime_relative() / 1000000.0;
         first_frame = false;
@@ -333,89 +514,23 @@ retry:
 
 display:
     video_display(is);                      // 取出当前帧vp(若有丢帧是nextvp)进行播放
-}
 
-static int video_playing_thread(void *arg)
-{
-    player_stat_t *is = (player_stat_t *)arg;
-    double remaining_time = 0.0;
-
-    while (1)
+    // 单帧播放(暂停时seek)：显示一帧后恢复暂停
+    if (is->step && !is->paused)
     {
-        if (remaining_time > 0.0)
-        {
-            av_usleep((unsigned)(remaining_time * 1000000.0));
-        }
-        remaining_time = REFRESH_RATE;
-        // 立即显示当前帧，或延时remaining_time后再显示
-        video_refresh(is, &remaining_time);
+        stream_toggle_pause(is);
     }
-
-    return 0;
 }
 
 static int open_video_playing(void *arg)
 {
     player_stat_t *is = (player_stat_t *)arg;
-    int ret;
-    int buf_size;
-    uint8_t* buffer = NULL;
 
+    // 解码帧格式SDL不支持时的转换目标，缓冲区在首次转换时按帧尺寸分配
     is->p_frm_yuv = av_frame_alloc();
     if (is->p_frm_yuv == NULL)
     {
-        printf("av_frame_alloc() for p_frm_raw failed\n");
-        return -1;
-    }
-
-    // 为AVFrame.*data[]手工分配缓冲区，用于存储sws_scale()中目的帧视频数据
-    buf_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, 
-                                        is->p_vcodec_ctx->width, 
-                                        is->p_vcodec_ctx->height, 
-                                        1
-                                        );
-    // buffer将作为p_frm_yuv的视频数据缓冲区
-    buffer = (uint8_t *)av_malloc(buf_size);
-    if (buffer == NULL)
-    {
-        printf("av_malloc() for buffer failed\n");
-        return -1;
-    }
-    // 使用给定参数设定p_frm_yuv->data和p_frm_yuv->linesize
-    ret = av_image_fill_arrays(is->p_frm_yuv->data,     // dst data[]
-                               is->p_frm_yuv->linesize, // dst linesize[]
-                               buffer,                  // src buffer
-                               AV_PIX_FMT_YUV420P,      // pixel format
-                               is->p_vcodec_ctx->width, // width
-                               is->p_vcodec_ctx->height,// height
-                               1                        // align
-                               );
-    if (ret < 0)
-    {
-        printf("av_image_fill_arrays() failed %d\n", ret);
-        return -1;;
-    }
-
-    // A2. 初始化SWS context，用于后续图像转换
-    //     此处第6个参数使用的是FFmpeg中的像素格式，对比参考注释B3
-    //     FFmpeg中的像素格式AV_PIX_FMT_YUV420P对应SDL中的像素格式SDL_PIXELFORMAT_IYUV
-    //     如果解码后得到图像的不被SDL支持，不进行图像转换的话，SDL是无法正常显示图像的
-    //     如果解码后得到图像的能被SDL支持，则不必进行图像转换
-    //     这里为了编码简便，统一转换为SDL支持的格式AV_PIX_FMT_YUV420P==>SDL_PIXELFORMAT_IYUV
-    is->img_convert_ctx = sws_getContext(is->p_vcodec_ctx->width,   // src width
-                                         is->p_vcodec_ctx->height,  // src height
-                                         is->p_vcodec_ctx->pix_fmt, // src format
-                                         is->p_vcodec_ctx->width,   // dst width
-                                         is->p_vcodec_ctx->height,  // dst height
-                                         AV_PIX_FMT_YUV420P,        // dst format
-                                         SWS_BICUBIC,               // flags
-                                         NULL,                      // src filter
-                                         NULL,                      // dst filter
-                                         NULL                       // param
-                                         );
-    if (is->img_convert_ctx == NULL)
-    {
-        printf("sws_getContext() failed\n");
+        printf("av_frame_alloc() for p_frm_yuv failed\n");
         return -1;
     }
 
@@ -441,29 +556,17 @@ static int open_video_playing(void *arg)
     }
 
     // 2. 创建SDL_Renderer
-    //    SDL_Renderer：渲染器
-    is->sdl_video.renderer = SDL_CreateRenderer(is->sdl_video.window, -1, 0);
+    //    SDL_Renderer：渲染器。开启垂直同步时SDL_RenderPresent()等到显示器刷新才返回，画面更新与刷新对齐
+    is->sdl_video.renderer = SDL_CreateRenderer(is->sdl_video.window, -1,
+                                                is->use_vsync ? SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC : 0);
     if (is->sdl_video.renderer == NULL)
     {  
         printf("SDL_CreateRenderer() failed: %s\n", SDL_GetError());  
         return -1;
     }
 
-    // 3. 创建SDL_Texture
-    //    一个SDL_Texture对应一帧YUV数据，同SDL 1.x中的SDL_Overlay
-   is->sdl_video.texture = SDL_CreateTexture(is->sdl_video.renderer, 
-                                    SDL_PIXELFORMAT_IYUV, 
-                                    SDL_TEXTUREACCESS_STREAMING,
-                                    is->sdl_video.rect.w,
-                                    is->sdl_video.rect.h
-                                    );
-    if (is->sdl_video.texture == NULL)
-    {  
-        printf("SDL_CreateTexture() failed: %s\n", SDL_GetError());  
-        return -1;
-    }
-
-    SDL_CreateThread(video_playing_thread, "video playing thread", is);
+    // 3. SDL_Texture在显示第一帧时按帧的像素格式创建，见upload_texture()
+    //    视频帧由主线程在事件循环中按播放时刻显示，渲染与创建渲染器在同一线程
 
     return 0;
 }
@@ -4,6 +4,8 @@
 #include "player.h"
 
 int open_video(player_stat_t *is);
+void video_refresh(player_stat_t *is, double *remaining_time);
+void video_refresh_wakeup(player_stat_t *is);
 
 #endif
 